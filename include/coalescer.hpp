@@ -0,0 +1,137 @@
+#ifndef __COALESCER_HPP__
+#define __COALESCER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "send_queue.hpp"
+
+namespace Communication
+{
+
+/**
+ * @brief Write coalescing of small messages on a stream socket.
+ *
+ * Writes are appended to a buffer which is sent in one syscall when it
+ * reaches the byte threshold, when the latency budget of its oldest byte
+ * expires (a timer thread shared by all the coalescers flushes it), or on
+ * flush(). A write that would cross the threshold is sent together with the
+ * buffered bytes in one sendmsg(), without being copied.
+ *
+ * The timer never blocks: when the socket buffer is full the bytes not sent
+ * stay in the buffer and the timer tries again later. A non-blocking socket
+ * gets the same treatment on write(), unless an overflow handler is set, in
+ * which case the coalescer never blocks and hands the bytes not sent to it.
+ * The class is thread-safe.
+ */
+class Coalescer
+{
+    public:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @brief Takes the bytes the socket did not take, in stream order. It is
+     * called with the lock of the coalescer held and must not call it.
+     */
+    typedef void (*Overflow)(void *data, SharedBuffer tail);
+
+    /**
+     * @param fd Connected stream socket.
+     * @param budget_us Maximum time a byte waits in the buffer (0 to send
+     * every write immediately).
+     * @param threshold Number of buffered bytes that triggers a send.
+     */
+    Coalescer(int fd, int budget_us = 50, size_t threshold = 16 * 1024);
+
+    /**
+     * @brief Drops the bytes not flushed yet, call flush() before.
+     */
+    ~Coalescer();
+
+    /**
+     * @brief Send without blocking and give the bytes left to overflow
+     * (an outgoing queue drained when the socket is writable).
+     */
+    void
+    set_overflow(Overflow overflow, void *data)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_overflow = overflow;
+        m_overflow_data = data;
+    }
+
+    /**
+     * @brief Queue bytes, sending them now if the threshold is reached.
+     * @return size, or -1 if the socket is closed or a send failed.
+     */
+    int
+    write(const void *buffer, size_t size);
+
+    /**
+     * @brief Send the buffered bytes now.
+     * @return Number of bytes sent, -1 on error.
+     */
+    int
+    flush();
+
+    /**
+     * @brief Drop the buffered bytes and stop using the socket, to be called
+     * before the socket is closed.
+     */
+    void
+    close();
+
+    size_t
+    pending()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_buffer.size();
+    }
+
+    /**
+     * @brief Number of send syscalls made.
+     */
+    uint64_t
+    sends() const
+    {
+        return m_sends;
+    }
+
+    protected:
+    friend class FlushTimer;
+
+    /**
+     * @brief Send the buffer followed by extra in one syscall (looping on
+     * partial writes) and empty the buffer. If the socket buffer fills up,
+     * the bytes left go to the overflow handler or back to the buffer, to be
+     * sent by the timer. m_mutex must be held.
+     * @param wait Let a blocking socket block (false from the timer).
+     * @return Number of bytes sent, -1 on error.
+     */
+    int
+    send_buffer(const void *extra, size_t extra_size, bool wait = true);
+
+    /**
+     * @brief Called by the timer thread when the budget expired.
+     */
+    void
+    on_deadline();
+
+    std::mutex m_mutex;
+    int m_fd;
+    std::chrono::microseconds m_budget;
+    size_t m_threshold;
+    std::vector<uint8_t> m_buffer;
+    bool m_armed = false; // a deadline is pending in the timer
+    Overflow m_overflow = nullptr;
+    void *m_overflow_data = nullptr;
+    std::atomic<uint64_t> m_sends{0};
+};
+
+} // namespace Communication
+
+#endif // __COALESCER_HPP__
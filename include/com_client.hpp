@@ -1,9 +1,13 @@
 #ifndef COM_CLIENT_HPP
 #define COM_CLIENT_HPP
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <math.h>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
+#include <vector>
 
 #ifdef WIN32 //////////// IF WINDOWS OS //////////
 #include <commctrl.h>
@@ -11,7 +15,7 @@
 #include <winsock2.h>
 #elif defined(linux) || defined(__APPLE__) ///// IF LINUX OS //////////
 #include <arpa/inet.h>
-#include <netdb.h> // gethostbyname
+#include <netdb.h> // getaddrinfo
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -19,6 +23,7 @@
 #include <errno.h> // Error integer and strerror() function
 #include <fcntl.h> // Contains file controls like O_RDWR
 #include <sys/time.h>
+#include <sys/uio.h> // writev(), struct iovec
 #include <termios.h> // Contains POSIX terminal control definitions
 #include <unistd.h>  // write(), read(), close()
 #else
@@ -27,8 +32,18 @@
 
 #include <strANSIseq.hpp>
 
-//server FIFO var for each client
-#include <unordered_set>
+#include "coalescer.hpp"
+#include "connection_table.hpp"
+#include "crc16.hpp"
+#include "error_queue.hpp"
+#include "fifo_limits.hpp"
+#include "framer.hpp"
+#include "resolver.hpp"
+#include "ring_buffer.hpp"
+#include "send_queue.hpp"
+#include "socket_profile.hpp"
+#include "timestamping.hpp"
+#include "zerocopy.hpp"
 
 #define CRLF "\r\n"
 
@@ -44,6 +59,13 @@ typedef struct sockaddr_in SOCKADDR_IN;
 typedef struct sockaddr SOCKADDR;
 typedef struct in_addr IN_ADDR;
 typedef timeval TIMEVAL;
+#else
+/** Segment of Client::writevS() (struct iovec of POSIX systems). */
+struct iovec
+{
+    void *iov_base;
+    size_t iov_len;
+};
 #endif
 
 /**
@@ -101,6 +123,18 @@ class Client : virtual public ESC::CLI
     virtual int
     writeS(const void *buffer, size_t size, bool add_crc = false) = 0;
 
+    /**
+     * @brief writevS write several segments (e.g. header and payload) in one
+     * system call (writev/sendmsg), without copying them in a staging buffer.
+     * @param segments Segments to send in order (left untouched).
+     * @param n_segments Number of segments.
+     * @param add_crc If true the CRC of all the segments (see set_crc()) is
+     * computed and sent as a two bytes trailer segment.
+     * @return number of bytes written (trailer included), -1 on error.
+     */
+    virtual int
+    writevS(const struct iovec *segments, int n_segments, bool add_crc = false);
+
     /**
      * @brief Check if the connection is open.
      * @return True if success, false otherwise.
@@ -111,17 +145,219 @@ class Client : virtual public ESC::CLI
         return m_is_connected;
     };
 
+    /**
+     * @brief Check the CRC stored in the two last bytes of buffer.
+     * @param buffer Frame including its CRC.
+     * @param size Size of the frame including the CRC.
+     * @return True if the CRC is valid.
+     */
     bool
     check_CRC(uint8_t *buffer, int size);
 
+    /**
+     * @brief Check a block of fixed-size frames, e.g. read with one readS(),
+     * in one call (see CRCSpec::check_frames()).
+     * @param frames First frame.
+     * @param frame_size Size of each frame, CRC included.
+     * @param n_frames Number of frames.
+     * @param valid Bitmap of (n_frames + 63) / 64 words, bit i set if frame i
+     * is valid.
+     * @return Number of valid frames.
+     */
+    size_t
+    check_CRC(const uint8_t *frames,
+              size_t frame_size,
+              size_t n_frames,
+              uint64_t *valid)
+    {
+        return m_crc.check_frames(frames, frame_size, n_frames, valid);
+    }
+
     /**
      * @brief CRC Compute and return the CRC over the n first bytes of buf
-     * @param buf path of the dir to look inside
-     * @param n reference to the vector of string that will be filled with the directories that are in the path.
+     * @param buf Data.
+     * @param n Number of bytes.
+     * @return The CRC with the byte order of the frame trailer, as read by a
+     * native uint16_t load of the two bytes appended by writeS().
      */
     uint16_t
     CRC(uint8_t *buf, int n);
 
+    /**
+     * @brief Select the CRC variant used by readS()/writeS()
+     * (default CRC16_XMODEM), e.g. set_crc(CRC16_MODBUS::spec()).
+     */
+    void
+    set_crc(const CRCSpec &spec)
+    {
+        m_crc = spec;
+    }
+
+    const CRCSpec &
+    get_crc() const
+    {
+        return m_crc;
+    }
+
+    /**
+     * @brief Enable the buffered reader of TCP and Serial clients: readS()
+     * pulls large chunks from the fd into an internal ring and serves the
+     * following reads from memory, saving a syscall per small read.
+     * @param enable True to enable, false to go back to direct reads (the
+     * bytes still buffered are dropped).
+     * @param capacity Size of the ring (rounded up to a power of two).
+     */
+    void
+    set_buffered(bool enable, size_t capacity = 64 * 1024);
+
+    bool
+    is_buffered() const
+    {
+        return m_rx_buffer != nullptr;
+    }
+
+    /**
+     * @brief Copy bytes from the buffered reader without consuming them.
+     * @param buffer Destination.
+     * @param size Number of bytes to peek.
+     * @param wait If true, read from the fd until size bytes are buffered.
+     * @return Number of bytes copied, -1 if not in buffered mode or on error.
+     */
+    int
+    peekS(uint8_t *buffer, size_t size, bool wait = true);
+
+    /**
+     * @brief Number of bytes that can be read without blocking: the bytes
+     * held by the buffered reader plus the ones pending in the kernel.
+     */
+    size_t
+    readable();
+
+    /**
+     * @brief Read the next whole frame through the buffered reader (enabled
+     * if needed, and enlarged to hold the largest frame).
+     * @param framer Framing of the stream, keep the same one between calls.
+     * @param frame Set to the payload of the frame. It points in the reader
+     * ring when the frame is contiguous in it (no copy) and stays valid until
+     * the next read.
+     * @param size Set to the size of the payload.
+     * @return 1 if a frame was read, 0 if the connection is closed, -1 if a
+     * frame was dropped (wrong CRC or oversized).
+     */
+    int
+    read_frame(Framer &framer, const uint8_t *&frame, size_t &size);
+
+    /**
+     * @brief Tune the socket of TCP and UDP clients (see SocketProfile). The
+     * profile is applied now if the socket is open, and to the sockets opened
+     * later by open_connection().
+     * @return The values applied by the kernel (all -1 if no socket is open).
+     */
+    SocketProfile
+    set_profile(const SocketProfile &profile);
+
+    /**
+     * @brief Current values of the options of the socket.
+     */
+    SocketProfile
+    get_profile()
+    {
+        return m_fd == INVALID_SOCKET ? SocketProfile()
+                                      : SocketProfile::query(m_fd);
+    }
+
+    /**
+     * @brief Enable write coalescing of TCP clients: writeS() appends the
+     * messages to a buffer sent in one syscall when threshold bytes are
+     * queued, when its oldest byte waited budget_us, or on flush().
+     * @param enable True to enable, false to flush and go back to one send
+     * per writeS().
+     * @param budget_us Latency budget of a message, in microseconds.
+     * @param threshold Number of queued bytes that triggers a send.
+     */
+    void
+    set_coalescing(bool enable,
+                   int budget_us = 50,
+                   size_t threshold = 16 * 1024);
+
+    /**
+     * @brief Send the messages queued by the coalescing mode now.
+     * @return Number of bytes sent, -1 on error.
+     */
+    int
+    flush();
+
+    /**
+     * @brief Send a buffer without copying it into the kernel (MSG_ZEROCOPY,
+     * TCP clients on Linux) when it is at least set_zerocopy_threshold()
+     * bytes long, like writeS() otherwise.
+     * @param id Set to the id to give to zerocopy_done() before the buffer
+     * is modified or freed, 0 when the buffer was copied.
+     * @param add_crc If true two more bytes are added to the buffer to store
+     * a CRC16 (they are part of the zero-copy send).
+     * @return number of bytes written, -1 on error.
+     */
+    virtual int
+    write_zerocopy(const void *buffer,
+                   size_t size,
+                   uint64_t *id = nullptr,
+                   bool add_crc = false);
+
+    /**
+     * @brief Tell whether the buffer of a write_zerocopy() can be reused.
+     * @param timeout_ms Time to wait for the completion (0 to only check, -1
+     * to wait until it comes).
+     */
+    bool
+    zerocopy_done(uint64_t id, int timeout_ms = 0);
+
+    /**
+     * @brief Smallest buffer write_zerocopy() sends without a copy.
+     */
+    void
+    set_zerocopy_threshold(size_t threshold);
+
+    /**
+     * @brief Measure with kernel TX timestamps (Linux) the time from a write
+     * to its bytes being handed to the device, and to their ACK by the peer
+     * (TCP). Applies to the open connection and to the next ones. The
+     * timestamps share the error queue with the completions of
+     * write_zerocopy(), which discards them.
+     */
+    void
+    set_tx_timestamping(bool enable);
+
+    /**
+     * @brief Time from writeS()/writevS() to the software TX timestamp.
+     */
+    LatencyStats
+    send_latency();
+
+    /**
+     * @brief Time from writeS()/writevS() to the ACK of the last byte (TCP).
+     */
+    LatencyStats
+    ack_latency();
+
+    /**
+     * @brief Number of send syscalls made by writeS() (coalesced or not).
+     */
+    uint64_t
+    tx_syscalls() const
+    {
+        return m_tx_syscalls + (m_tx ? m_tx->sends() : 0);
+    }
+
+    /**
+     * @brief Number of read/recv syscalls made by readS(), peekS() and
+     * read_frame().
+     */
+    uint64_t
+    rx_syscalls() const
+    {
+        return m_rx_syscalls;
+    }
+
     void
     get_stat(char c = 'd', int pkgSize = 6)
     {
@@ -139,30 +375,138 @@ class Client : virtual public ESC::CLI
         delete[] buf;
     }
 
-    private:
+    protected:
     /**
-     * @brief mk_crctable Create a CRC lookup table to compute CRC16 fatser.
-     * @param poly Represent the coeficients use for the polynome of the CRC
+     * @brief Copy the segments of writevS() in iov and, if add_crc, add a
+     * segment pointing to trailer filled with their CRC.
      */
     void
-    mk_crctable(uint16_t genpoly = 0x1021);
-    static uint16_t s_crctable[256];
+    CRC_segments(const struct iovec *segments,
+                 int n_segments,
+                 bool add_crc,
+                 uint8_t trailer[2],
+                 std::vector<struct iovec> &iov);
+
+    /**
+     * @brief Write the CRC of the size first bytes of buffer at buffer + size.
+     */
+    void
+    append_CRC(uint8_t *buffer, size_t size)
+    {
+        CRCAccumulator(m_crc).update(buffer, size).store(buffer + size);
+    }
+
+    /**
+     * @brief Feed the bytes of a frame received since the last call to the
+     * CRC while they are still in cache, so that readS() does not walk the
+     * whole frame again once it is complete.
+     * @param crc Accumulator of the frame (crc.length() bytes already fed).
+     * @param frame Frame being received.
+     * @param size Size of the frame, CRC included.
+     * @param received Number of bytes of the frame received so far.
+     */
+    void
+    update_CRC(CRCAccumulator &crc,
+               const uint8_t *frame,
+               size_t size,
+               size_t received)
+    {
+        size_t end = std::min(received, size < 2 ? 0 : size - 2);
+        if(end > crc.length())
+            crc.update(frame + crc.length(), end - crc.length());
+    }
+
+    /**
+     * @brief Feed what update_CRC() did not see yet and compare the CRC with
+     * the trailer of the frame.
+     * @return True if the CRC is valid.
+     */
+    bool
+    finish_CRC(CRCAccumulator &crc, uint8_t *frame, size_t size)
+    {
+        update_CRC(crc, frame, size, size);
+        if(size < 2 || !crc.verify(frame + size - 2))
+        {
+            logln("CRC error", true);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief readS() of the buffered mode, m_rx_mutex must be held.
+     */
+    int
+    read_buffered(uint8_t *buffer, size_t size, bool has_crc, bool read_until);
+
+    /**
+     * @brief One read from the fd into the free space of the ring.
+     * @return Number of bytes read, 0 on end of stream, -1 on error.
+     */
+    long
+    fill_buffer();
+
+    /**
+     * @brief TCP_QUICKACK is cleared by the kernel, set it again after a read
+     * if the profile asks for it.
+     */
+    void
+    rearm_quickack();
 
-    protected:
     /** Returns true on success, or false if there was an error */
     bool
     SetSocketBlockingEnabled(bool blocking);
 
-    SOCKET m_fd;
-    bool m_is_connected = false;
-    std::mutex *m_mutex;
+    /**
+     * @brief Error queue of the socket, shared by the zero-copy sends and
+     * the TX timestamps. m_tx_mutex must be held, or the socket not in use
+     * yet (open_connection()).
+     */
+    std::shared_ptr<ErrorQueue>
+    error_queue()
+    {
+        if(!m_errors || m_errors->fd() != (int)m_fd)
+            m_errors = std::make_shared<ErrorQueue>(m_fd);
+        return m_errors;
+    }
+
+    SOCKET m_fd = INVALID_SOCKET;
+    std::atomic<bool> m_is_connected{false};
+    // readers and writers lock one direction each, so a reader blocked on
+    // the device does not hold back the writers (full duplex)
+    std::mutex m_rx_mutex;
+    std::mutex m_tx_mutex;
     SOCKADDR_IN m_addr_to;
     std::string m_id;
+    CRCSpec m_crc = CRC16_XMODEM::spec();
+    std::unique_ptr<RingBuffer> m_rx_buffer;
+    uint64_t m_rx_syscalls = 0;
+    std::unique_ptr<Coalescer> m_tx; // created by the first coalesced write
+    int m_tx_budget_us = -1;         // -1 when coalescing is disabled
+    size_t m_tx_threshold = 0;
+    uint64_t m_tx_syscalls = 0;
+    // shared with zerocopy_done(), which waits without m_tx_mutex
+    std::shared_ptr<ZeroCopy> m_zc;
+    std::shared_ptr<ErrorQueue> m_errors; // see error_queue()
+    size_t m_zc_threshold = 16 * 1024;
+    std::unique_ptr<TxTimestamps> m_tx_stamps; // see set_tx_timestamping()
+    SocketProfile m_profile;
 };
 
 class Server : virtual public ESC::CLI
 {
     public:
+    /**
+     * @brief I/O model used to receive data from the clients.
+     */
+    enum Engine
+    {
+        THREADS, ///< Blocking receive thread(s) (default).
+        REACTOR, ///< epoll threads multiplexing accept/receive/close (Linux).
+        IO_URING ///< io_uring multishot receive, falls back to THREADS if the
+                 ///< kernel lacks support (Linux).
+    };
+
     Server(int port, int max_connections = 10, int verbose = -1)
         : ESC::CLI(verbose, "Server"), m_port(port),
           m_max_connections(max_connections), m_is_running(false)
@@ -213,12 +557,109 @@ class Server : virtual public ESC::CLI
         (void)size;
     }
 
+    /**
+     * @brief Select the CRC variant of the frames read with has_crc
+     * (default CRC16_XMODEM).
+     */
+    void
+    set_crc(const CRCSpec &spec)
+    {
+        m_crc = spec;
+    }
+
     // virtual int
     // send_data(const void *buffer, size_t size, void *addr = nullptr){};
 
     // virtual int
     // send_data(const void *buffer, size_t size, SOCKET s){};
 
+    /**
+     * @brief Tune the server sockets (see SocketProfile): the listening or
+     * datagram socket and every accepted TCP socket. Must be called before
+     * start().
+     */
+    void
+    set_profile(const SocketProfile &profile)
+    {
+        if(m_is_running)
+            throw log_error("Cannot change the profile of a running server");
+        m_profile = profile;
+    }
+
+    /**
+     * @brief Values the kernel applied to a socket of the server (the
+     * server socket if s is INVALID_SOCKET).
+     */
+    SocketProfile
+    get_profile(SOCKET s = INVALID_SOCKET)
+    {
+        return SocketProfile::query(s == INVALID_SOCKET ? m_fd : s);
+    }
+
+    /**
+     * @brief Select the I/O engine. Must be called before start().
+     * @param engine THREADS, REACTOR or IO_URING.
+     * @param n_threads Number of I/O threads used by the REACTOR engine.
+     */
+    void
+    set_engine(Engine engine, int n_threads = 1)
+    {
+        if(m_is_running)
+            throw log_error("Cannot change the engine of a running server");
+        m_engine = engine;
+        m_n_io_threads = n_threads < 1 ? 1 : n_threads;
+    }
+
+    /**
+     * @brief Number of bytes received from all the clients.
+     */
+    uint64_t
+    rx_bytes() const
+    {
+        return m_rx_bytes;
+    }
+
+    /**
+     * @brief Bound the receive FIFO of each client (see FifoLimits). Must be
+     * called before start().
+     */
+    virtual void
+    set_fifo_limits(const FifoLimits &limits)
+    {
+        if(m_is_running)
+            throw log_error("Cannot change the FIFO limits of a running server");
+        m_fifo_limits = limits;
+    }
+
+    /**
+     * @brief Limit the bytes held by the receive FIFOs of all the servers of
+     * the process (0 for no limit). Past it, the FIFO limit policy applies.
+     */
+    static void
+    set_memory_budget(size_t bytes)
+    {
+        MemoryBudget::instance().set_limit(bytes);
+    }
+
+    /**
+     * @brief Number of received bytes dropped by the FIFO limits.
+     */
+    uint64_t
+    rx_dropped() const
+    {
+        return m_rx_dropped;
+    }
+
+    /**
+     * @brief Number of receive syscalls (recv, epoll_wait, io_uring_enter...)
+     * made by the engine.
+     */
+    uint64_t
+    rx_syscalls() const
+    {
+        return m_rx_syscalls;
+    }
+
     /**
      * @brief Check if the server is running.
      * @return True if the server is running, false otherwise.
@@ -245,6 +686,47 @@ class Server : virtual public ESC::CLI
         m_callback_data = data;
     }
 
+    /**
+     * @brief Like set_callback(), with the timestamps of the received chunk
+     * (see set_timestamping()). Used instead of the plain callback.
+     */
+    void
+    set_timestamped_callback(void (*callback)(Server *server,
+                                              uint8_t *buffer,
+                                              size_t size,
+                                              void *addr,
+                                              const RxTimestamp &ts,
+                                              void *data),
+                             void *data = nullptr)
+    {
+        m_ts_callback = callback;
+        m_ts_callback_data = data;
+    }
+
+    /**
+     * @brief Ask the kernel for software RX timestamps (Linux) of the data
+     * received from the clients. They are given to the timestamped callback
+     * and kept with the FIFO data. Must be called before start().
+     */
+    void
+    set_timestamping(bool enable = true)
+    {
+        if(m_is_running)
+            throw log_error("Cannot enable timestamping on a running server");
+        m_timestamping = enable;
+    }
+
+    /**
+     * @brief Time from the kernel RX timestamp of the received chunks to the
+     * call of their callback.
+     */
+    LatencyStats
+    rx_latency()
+    {
+        std::lock_guard<std::mutex> lock(m_latency_mutex);
+        return m_rx_latency;
+    }
+
     void
     set_callback_newClient(void (*callback)(Server *server,
                                             void *addr,
@@ -256,10 +738,15 @@ class Server : virtual public ESC::CLI
         m_callback_data_newClient = data;
     }
 
-    std::unordered_set<SOCKET> &
+    /**
+     * @brief Sockets of the connected clients (none for connectionless
+     * servers). The list is a snapshot: it does not change afterwards and is
+     * cheap to copy.
+     */
+    virtual Snapshot<SOCKET>
     get_clients()
     {
-        return m_clients;
+        return Snapshot<SOCKET>();
     }
 
     protected:
@@ -276,23 +763,54 @@ class Server : virtual public ESC::CLI
     virtual void
     handle_client(SOCKET client_socket) = 0;
 
+    /**
+     * @brief Account for the socket-to-callback latency of a chunk, to be
+     * called right before its callback.
+     */
+    void
+    record_rx_latency(const RxTimestamp &ts)
+    {
+        if(!ts.kernel_ns)
+            return;
+        int64_t ns = Timestamping::now_ns() - ts.kernel_ns;
+        std::lock_guard<std::mutex> lock(m_latency_mutex);
+        m_rx_latency.add(ns);
+    }
+
     SOCKET m_fd = INVALID_SOCKET;
     int m_port;
     int m_max_connections;
     bool m_is_running;
-    std::unordered_set<SOCKET> m_clients;
+    Engine m_engine = THREADS;
+    int m_n_io_threads = 1;
+    std::atomic<uint64_t> m_rx_bytes{0};
+    std::atomic<uint64_t> m_rx_syscalls{0};
+    std::atomic<uint64_t> m_rx_dropped{0};
+    FifoLimits m_fifo_limits;
+    CRCSpec m_crc = CRC16_XMODEM::spec();
+    SocketProfile m_profile;
+    bool m_timestamping = false;
+    std::mutex m_latency_mutex;
+    LatencyStats m_rx_latency;
     //callback(this)
     void (*m_callback)(Server *server,
                        uint8_t *buffer,
                        size_t size,
                        void *addr,
                        void *data) = nullptr;
+    void (*m_ts_callback)(Server *server,
+                          uint8_t *buffer,
+                          size_t size,
+                          void *addr,
+                          const RxTimestamp &ts,
+                          void *data) = nullptr;
     void (*m_callback_newClient)(Server *server,
                                  void *addr,
                                  SOCKET client_socket,
                                  void *data) = nullptr;
     void *m_callback_data;
     void *m_callback_data_newClient;
+    void *m_ts_callback_data = nullptr;
 };
 
 } // namespace Communication
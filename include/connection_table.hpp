@@ -0,0 +1,207 @@
+#ifndef __CONNECTION_TABLE_HPP__
+#define __CONNECTION_TABLE_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Communication
+{
+
+/**
+ * @brief Immutable list of keys, cheap to copy: the copies share the list.
+ */
+template <typename Key>
+class Snapshot
+{
+    public:
+    typedef typename std::vector<Key>::const_iterator const_iterator;
+
+    Snapshot() : m_keys(std::make_shared<const std::vector<Key>>()) {}
+    explicit Snapshot(std::shared_ptr<const std::vector<Key>> keys)
+        : m_keys(std::move(keys))
+    {
+    }
+
+    const_iterator
+    begin() const
+    {
+        return m_keys->begin();
+    }
+    const_iterator
+    end() const
+    {
+        return m_keys->end();
+    }
+    size_t
+    size() const
+    {
+        return m_keys->size();
+    }
+    bool
+    empty() const
+    {
+        return m_keys->empty();
+    }
+    /**
+     * @return 1 if the key is in the list, 0 otherwise.
+     */
+    size_t
+    count(const Key &key) const
+    {
+        return std::find(begin(), end(), key) != end();
+    }
+
+    private:
+    std::shared_ptr<const std::vector<Key>> m_keys;
+};
+
+/**
+ * @brief Concurrent map from a key (a socket) to a shared state.
+ *
+ * The entries are spread over shards, each with its own mutex, so that
+ * threads working on different connections rarely contend. The states are
+ * held by shared_ptr: a state found by a thread stays valid after it is
+ * erased from the table, and a rehash never moves it. snapshot() returns the
+ * list of the keys, rebuilt only when the table changed since the last call.
+ */
+template <typename Key, typename T, size_t N_SHARDS = 16>
+class ConnectionTable
+{
+    public:
+    /**
+     * @return The state of key, nullptr if it is not in the table.
+     */
+    std::shared_ptr<T>
+    find(const Key &key) const
+    {
+        const Shard &s = shard(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.map.find(key);
+        return it == s.map.end() ? nullptr : it->second;
+    }
+
+    /**
+     * @brief Add or replace the state of key.
+     */
+    void
+    insert(const Key &key, std::shared_ptr<T> value)
+    {
+        Shard &s = shard(key);
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.map.find(key);
+            if(it != s.map.end())
+                it->second = std::move(value);
+            else
+            {
+                s.map.emplace(key, std::move(value));
+                m_size++;
+            }
+        }
+        m_version++;
+    }
+
+    /**
+     * @brief Remove key from the table.
+     * @return Its state, nullptr if it was not in the table.
+     */
+    std::shared_ptr<T>
+    erase(const Key &key)
+    {
+        Shard &s = shard(key);
+        std::shared_ptr<T> value;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.map.find(key);
+            if(it == s.map.end())
+                return nullptr;
+            value = std::move(it->second);
+            s.map.erase(it);
+            m_size--;
+        }
+        m_version++;
+        return value;
+    }
+
+    size_t
+    size() const
+    {
+        return m_size;
+    }
+
+    /**
+     * @brief Call f(key, state) on every entry, one shard locked at a time:
+     * f must not call the table.
+     */
+    template <typename F>
+    void
+    for_each(F f)
+    {
+        for(Shard &s : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            for(auto &entry : s.map) f(entry.first, entry.second);
+        }
+    }
+
+    /**
+     * @brief Keys of the table. The entries inserted or erased while the
+     * list is built may or may not be in it.
+     */
+    Snapshot<Key>
+    snapshot()
+    {
+        std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+        uint64_t version = m_version;
+        if(!m_snapshot || version != m_snapshot_version)
+        {
+            std::shared_ptr<std::vector<Key>> keys =
+                std::make_shared<std::vector<Key>>();
+            keys->reserve(m_size);
+            for(Shard &s : m_shards)
+            {
+                std::lock_guard<std::mutex> shard_lock(s.mutex);
+                for(auto &entry : s.map) keys->push_back(entry.first);
+            }
+            m_snapshot = keys;
+            m_snapshot_version = version;
+        }
+        return Snapshot<Key>(m_snapshot);
+    }
+
+    private:
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<Key, std::shared_ptr<T>> map;
+    };
+
+    Shard &
+    shard(const Key &key)
+    {
+        return m_shards[std::hash<Key>()(key) % N_SHARDS];
+    }
+    const Shard &
+    shard(const Key &key) const
+    {
+        return m_shards[std::hash<Key>()(key) % N_SHARDS];
+    }
+
+    Shard m_shards[N_SHARDS];
+    std::atomic<size_t> m_size{0};
+    std::atomic<uint64_t> m_version{0}; // bumped on every insert and erase
+    std::mutex m_snapshot_mutex;
+    std::shared_ptr<const std::vector<Key>> m_snapshot;
+    uint64_t m_snapshot_version = 0;
+};
+
+} // namespace Communication
+
+#endif // __CONNECTION_TABLE_HPP__
@@ -0,0 +1,452 @@
+#ifndef __CRC16_HPP__
+#define __CRC16_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(linux) || defined(__APPLE__)
+#include <sys/uio.h>
+#endif
+
+namespace Communication
+{
+
+/**
+ * @brief CRC-16 engine for the polynomial 0x1021 (MSB first, no reflection).
+ *
+ * Several kernels compute the same checksum, the fastest one supported by the
+ * CPU is picked the first time update() is called:
+ *  - TABLE: one table lookup per byte (reference implementation),
+ *  - SLICING_8 / SLICING_16: 8 or 16 bytes per iteration with 8 or 16 tables,
+ *  - PCLMUL: carry-less multiplication folding of 64 bytes per iteration
+ *    (x86-64 with PCLMULQDQ and SSSE3).
+ *
+ * update() only runs the shift register: the caller chooses the initial value
+ * and applies the final XOR / byte order (see Client::CRC()).
+ */
+namespace CRC16
+{
+
+enum Kernel
+{
+    TABLE,
+    SLICING_8,
+    SLICING_16,
+    PCLMUL,
+    N_KERNELS
+};
+
+/**
+ * @brief Feed n bytes to the CRC register with the fastest kernel.
+ * @param crc Current register value (initial value for the first call).
+ * @param buf Data.
+ * @param n Number of bytes.
+ * @return The new register value.
+ */
+uint16_t
+update(uint16_t crc, const uint8_t *buf, size_t n);
+
+/**
+ * @brief Same as update() with an explicit kernel. An unsupported kernel
+ * falls back to SLICING_16.
+ */
+uint16_t
+update(Kernel kernel, uint16_t crc, const uint8_t *buf, size_t n);
+
+/**
+ * @brief Copy n bytes from src to dst and feed them to the CRC register in
+ * the same pass, so that each byte is read once from memory.
+ * @return The new register value.
+ */
+uint16_t
+update_copy(uint16_t crc, uint8_t *dst, const uint8_t *src, size_t n);
+
+uint16_t
+update_copy(Kernel kernel,
+            uint16_t crc,
+            uint8_t *dst,
+            const uint8_t *src,
+            size_t n);
+
+/**
+ * @brief Feed n bytes of 4 independent buffers to 4 registers. The streams
+ * are processed in lockstep so that their table lookups (or carry-less
+ * multiplications) overlap instead of waiting on one dependency chain.
+ * @param crc The 4 registers, updated.
+ * @param buf The 4 buffers.
+ * @param n Number of bytes of each buffer.
+ */
+void
+update_x4(uint16_t crc[4], const uint8_t *const buf[4], size_t n);
+
+void
+update_x4(Kernel kernel, uint16_t crc[4], const uint8_t *const buf[4], size_t n);
+
+/**
+ * @brief Check that the CPU can run a kernel.
+ */
+bool
+supported(Kernel kernel);
+
+/**
+ * @brief Kernel used by update(crc, buf, n).
+ */
+Kernel
+active_kernel();
+
+const char *
+kernel_name(Kernel kernel);
+
+} // namespace CRC16
+
+/**
+ * @brief Lookup tables of a CRC-16, generated at compile time.
+ * t[0][b] is the CRC of the byte b, t[k][b] the CRC of b followed by k zero
+ * bytes (used by the slicing-by-N loops).
+ * @tparam Poly Polynomial in normal (MSB first) notation.
+ * @tparam Reflect True for a CRC processing the bits LSB first.
+ * @tparam N Number of tables.
+ */
+template <uint16_t Poly, bool Reflect, int N>
+struct CRCTable
+{
+    uint16_t t[N][256];
+
+    constexpr CRCTable() : t()
+    {
+        uint16_t rpoly = 0;
+        for(int i = 0; i < 16; i++)
+            if(Poly & (1 << i))
+                rpoly |= 1 << (15 - i);
+        for(int b = 0; b < 256; b++)
+        {
+            uint16_t crc = Reflect ? b : b << 8;
+            for(int i = 0; i < 8; i++)
+                if(Reflect)
+                    crc = (crc & 1) ? (crc >> 1) ^ rpoly : crc >> 1;
+                else
+                    crc = (crc & 0x8000) ? (crc << 1) ^ Poly : crc << 1;
+            t[0][b] = crc;
+        }
+        for(int k = 1; k < N; k++)
+            for(int b = 0; b < 256; b++)
+                t[k][b] = Reflect ? (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xff]
+                                  : (t[k - 1][b] << 8) ^ t[0][t[k - 1][b] >> 8];
+    }
+};
+
+/**
+ * @brief Runtime description of a CRC-16 variant, so that a Client can
+ * switch between the policies below (see Client::set_crc()).
+ */
+struct CRCSpec
+{
+    /// Feed bytes to the CRC register (no init/final XOR).
+    uint16_t (*update)(uint16_t crc, const uint8_t *buf, size_t n);
+    /// Same as update while copying the bytes from src to dst.
+    uint16_t (*update_copy)(uint16_t crc,
+                            uint8_t *dst,
+                            const uint8_t *src,
+                            size_t n);
+    /// Same as update on 4 independent streams of n bytes.
+    void (*update_x4)(uint16_t crc[4], const uint8_t *const buf[4], size_t n);
+    uint16_t init;
+    uint16_t xorout;
+    /// Byte order of the CRC appended to the frames.
+    bool big_endian;
+
+    uint16_t
+    compute(const uint8_t *buf, size_t n) const
+    {
+        return update(init, buf, n) ^ xorout;
+    }
+
+    /**
+     * @brief Write the CRC of the n first bytes of buf at buf + n.
+     */
+    void
+    append(uint8_t *buf, size_t n) const
+    {
+        store(compute(buf, n), buf + n);
+    }
+
+    /**
+     * @brief Compare a register fed with a whole frame body (starting from
+     * init) with the CRC stored in its trailer.
+     */
+    bool
+    verify(uint16_t crc, const uint8_t *trailer) const
+    {
+        return (crc ^ xorout) == load(trailer);
+    }
+
+    /**
+     * @brief Check the CRC stored in the two last bytes of a frame.
+     */
+    bool
+    check(const uint8_t *frame, size_t size) const
+    {
+        return size >= 2 && compute(frame, size - 2) == load(frame + size - 2);
+    }
+
+    /**
+     * @brief Check n_frames contiguous frames of frame_size bytes (CRC
+     * included), 4 at a time.
+     * @param frames First frame.
+     * @param frame_size Size of each frame.
+     * @param n_frames Number of frames.
+     * @param valid Bitmap of (n_frames + 63) / 64 words: bit i is set if
+     * frame i is valid.
+     * @return Number of valid frames.
+     */
+    size_t
+    check_frames(const uint8_t *frames,
+                 size_t frame_size,
+                 size_t n_frames,
+                 uint64_t *valid) const;
+
+    /**
+     * @brief Same as above for a list of frames of any size.
+     * @param frames Address of each frame.
+     * @param sizes Size of each frame, CRC included.
+     */
+    size_t
+    check_frames(const uint8_t *const *frames,
+                 const size_t *sizes,
+                 size_t n_frames,
+                 uint64_t *valid) const;
+
+    void
+    store(uint16_t crc, uint8_t *dst) const
+    {
+        dst[big_endian ? 0 : 1] = crc >> 8;
+        dst[big_endian ? 1 : 0] = crc & 0xff;
+    }
+
+    uint16_t
+    load(const uint8_t *src) const
+    {
+        return big_endian ? (src[0] << 8) | src[1] : (src[1] << 8) | src[0];
+    }
+};
+
+/**
+ * @brief CRC-16 policy: every parameter is known at compile time and the
+ * tables are constant data, nothing is built at runtime.
+ * The non-reflected 0x1021 variants use the dispatched CRC16::update() engine,
+ * the others a slicing-by-8 loop over constexpr tables.
+ * Reflected variants put the CRC LSB first in the frames, the others MSB
+ * first (the usual convention of each family).
+ * @tparam Poly Polynomial in normal (MSB first) notation.
+ * @tparam Init Initial register value.
+ * @tparam Reflect True for a CRC processing the bits LSB first.
+ * @tparam XorOut Value XORed to the register to get the CRC.
+ */
+template <uint16_t Poly, uint16_t Init, bool Reflect, uint16_t XorOut>
+struct CRC16Policy
+{
+    static const uint16_t poly = Poly;
+    static const uint16_t init = Init;
+    static const bool reflect = Reflect;
+    static const uint16_t xorout = XorOut;
+
+    static const CRCTable<Poly, Reflect, 8> &
+    table()
+    {
+        static constexpr CRCTable<Poly, Reflect, 8> s_table{};
+        return s_table;
+    }
+
+    /**
+     * @brief One slicing-by-8 step over buf[0..7].
+     */
+    static uint16_t
+    update8(uint16_t crc, const uint8_t *buf)
+    {
+        const uint16_t(*t)[256] = table().t;
+        uint16_t acc;
+        if(Reflect)
+            acc = t[7][buf[0] ^ (crc & 0xff)] ^ t[6][buf[1] ^ (crc >> 8)];
+        else
+            acc = t[7][buf[0] ^ (crc >> 8)] ^ t[6][buf[1] ^ (crc & 0xff)];
+        return acc ^ t[5][buf[2]] ^ t[4][buf[3]] ^ t[3][buf[4]] ^
+               t[2][buf[5]] ^ t[1][buf[6]] ^ t[0][buf[7]];
+    }
+
+    static uint16_t
+    update(uint16_t crc, const uint8_t *buf, size_t n)
+    {
+        if(Poly == 0x1021 && !Reflect)
+            return CRC16::update(crc, buf, n);
+
+        const uint16_t *t = table().t[0];
+        for(; n >= 8; n -= 8, buf += 8) crc = update8(crc, buf);
+        for(; n > 0; n--, buf++)
+            crc = Reflect ? (crc >> 8) ^ t[(crc ^ *buf) & 0xff]
+                          : (crc << 8) ^ t[(crc >> 8) ^ *buf];
+        return crc;
+    }
+
+    static void
+    update_x4(uint16_t crc[4], const uint8_t *const buf[4], size_t n)
+    {
+        if(Poly == 0x1021 && !Reflect)
+            return CRC16::update_x4(crc, buf, n);
+
+        size_t i = 0;
+        for(; i + 8 <= n; i += 8)
+            for(int l = 0; l < 4; l++) crc[l] = update8(crc[l], buf[l] + i);
+        for(int l = 0; l < 4; l++) crc[l] = update(crc[l], buf[l] + i, n - i);
+    }
+
+    static uint16_t
+    update_copy(uint16_t crc, uint8_t *dst, const uint8_t *src, size_t n)
+    {
+        if(Poly == 0x1021 && !Reflect)
+            return CRC16::update_copy(crc, dst, src, n);
+
+        // copy by chunks that stay in L1 and hash each chunk right away
+        for(size_t len; n > 0; n -= len, dst += len, src += len)
+        {
+            len = n < 1024 ? n : 1024;
+            memcpy(dst, src, len);
+            crc = update(crc, dst, len);
+        }
+        return crc;
+    }
+
+    static uint16_t
+    compute(const uint8_t *buf, size_t n)
+    {
+        return update(Init, buf, n) ^ XorOut;
+    }
+
+    static CRCSpec
+    spec()
+    {
+        return {&update, &update_copy, &update_x4, Init, XorOut, !Reflect};
+    }
+};
+
+// Common CRC-16 variants (check value of "123456789" in comment)
+/// Default of Client::CRC() (0x31C3).
+typedef CRC16Policy<0x1021, 0x0000, false, 0x0000> CRC16_XMODEM;
+/// CRC-16/CCITT-FALSE, also known as IBM-3740 (0x29B1).
+typedef CRC16Policy<0x1021, 0xFFFF, false, 0x0000> CRC16_CCITT_FALSE;
+/// CRC-16/KERMIT, the reflected CCITT (0x2189).
+typedef CRC16Policy<0x1021, 0x0000, true, 0x0000> CRC16_KERMIT;
+/// CRC-16/X-25, also known as IBM-SDLC (0x906E).
+typedef CRC16Policy<0x1021, 0xFFFF, true, 0xFFFF> CRC16_X25;
+/// CRC-16/MODBUS (0x4B37).
+typedef CRC16Policy<0x8005, 0xFFFF, true, 0x0000> CRC16_MODBUS;
+/// CRC-16/ARC, also known as CRC-16/IBM (0xBB3D).
+typedef CRC16Policy<0x8005, 0x0000, true, 0x0000> CRC16_ARC;
+
+/**
+ * @brief Incremental CRC: the data can be fed in any number of fragments
+ * (recv chunks, FIFO segments, iovecs...) without staging it in a contiguous
+ * buffer first.
+ *
+ *     CRCAccumulator crc(CRC16_MODBUS::spec());
+ *     crc.update(header, 4).update(payload, n);
+ *     crc.store(trailer);
+ */
+class CRCAccumulator
+{
+    public:
+    CRCAccumulator(const CRCSpec &spec = CRC16_XMODEM::spec())
+        : m_spec(spec), m_crc(spec.init)
+    {
+    }
+
+    /**
+     * @brief Feed n bytes.
+     */
+    CRCAccumulator &
+    update(const void *buf, size_t n)
+    {
+        m_crc = m_spec.update(m_crc, (const uint8_t *)buf, n);
+        m_length += n;
+        return *this;
+    }
+
+    /**
+     * @brief Feed n bytes while copying them from src to dst.
+     */
+    CRCAccumulator &
+    update_copy(void *dst, const void *src, size_t n)
+    {
+        m_crc = m_spec.update_copy(m_crc, (uint8_t *)dst, (const uint8_t *)src,
+                                   n);
+        m_length += n;
+        return *this;
+    }
+
+#if defined(linux) || defined(__APPLE__)
+    /**
+     * @brief Feed a scatter/gather list.
+     */
+    CRCAccumulator &
+    update(const struct iovec *iov, int iovcnt)
+    {
+        for(int i = 0; i < iovcnt; i++) update(iov[i].iov_base, iov[i].iov_len);
+        return *this;
+    }
+#endif
+
+    /**
+     * @brief Start a new CRC.
+     */
+    void
+    reset()
+    {
+        m_crc = m_spec.init;
+        m_length = 0;
+    }
+
+    /**
+     * @brief The CRC of the bytes fed so far (final XOR applied).
+     */
+    uint16_t
+    finalize() const
+    {
+        return m_crc ^ m_spec.xorout;
+    }
+
+    /**
+     * @brief Write the CRC in the byte order of the frames.
+     */
+    void
+    store(uint8_t *dst) const
+    {
+        m_spec.store(finalize(), dst);
+    }
+
+    /**
+     * @brief Compare the CRC with a frame trailer.
+     */
+    bool
+    verify(const uint8_t *trailer) const
+    {
+        return finalize() == m_spec.load(trailer);
+    }
+
+    /**
+     * @brief Number of bytes fed since the last reset.
+     */
+    size_t
+    length() const
+    {
+        return m_length;
+    }
+
+    private:
+    CRCSpec m_spec;
+    uint16_t m_crc;
+    size_t m_length = 0;
+};
+
+} // namespace Communication
+
+#endif // __CRC16_HPP__
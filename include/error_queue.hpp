@@ -0,0 +1,103 @@
+#ifndef __ERROR_QUEUE_HPP__
+#define __ERROR_QUEUE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace Communication
+{
+
+/**
+ * @brief Reader of the error queue of a socket (MSG_ERRQUEUE, Linux).
+ *
+ * The kernel reports both the zero-copy completions (see ZeroCopy) and the
+ * TX timestamps (see TxTimestamps) on the same queue, and a report read is
+ * gone. Both owners therefore read through the ErrorQueue of the socket,
+ * which keeps each report for its owner. The reports of a kind nobody asked
+ * for are dropped. The class is thread-safe; its lock is never held while
+ * calling out, so it can be taken under the locks of the owners.
+ */
+class ErrorQueue
+{
+    public:
+    /**
+     * @brief Zero-copy sends [lo, hi] (kernel ids) complete.
+     */
+    struct Completion
+    {
+        uint32_t lo;
+        uint32_t hi;
+        bool copied; ///< The kernel copied the buffers anyway.
+    };
+
+    /**
+     * @brief TX timestamp of kind SCM_TSTAMP_* for the write ending at id.
+     */
+    struct Timestamp
+    {
+        uint32_t kind;
+        uint32_t id;
+        int64_t ns;
+    };
+
+    explicit ErrorQueue(int fd) : m_fd(fd) {}
+
+    int
+    fd() const
+    {
+        return m_fd;
+    }
+
+    /**
+     * @brief Keep the zero-copy completions for take_completions().
+     */
+    void
+    want_completions()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_want_completions = true;
+    }
+
+    /**
+     * @brief Keep the TX timestamps for take_timestamps().
+     */
+    void
+    want_timestamps()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_want_timestamps = true;
+    }
+
+    /**
+     * @brief Read the queue without blocking and return the zero-copy
+     * completions received since the last call.
+     */
+    std::vector<Completion>
+    take_completions();
+
+    /**
+     * @brief Same for the TX timestamps.
+     */
+    std::vector<Timestamp>
+    take_timestamps();
+
+    protected:
+    /**
+     * @brief Read the reports waiting on the queue. m_mutex must be held.
+     */
+    void
+    read();
+
+    std::mutex m_mutex;
+    int m_fd;
+    bool m_want_completions = false;
+    bool m_want_timestamps = false;
+    std::vector<Completion> m_completions;
+    std::vector<Timestamp> m_timestamps;
+};
+
+} // namespace Communication
+
+#endif // __ERROR_QUEUE_HPP__
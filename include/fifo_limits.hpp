@@ -0,0 +1,165 @@
+#ifndef __FIFO_LIMITS_HPP__
+#define __FIFO_LIMITS_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace Communication
+{
+
+/**
+ * @brief Bytes held by the receive FIFOs of all the servers of the process,
+ * against an optional limit. Thread-safe.
+ */
+class MemoryBudget
+{
+    public:
+    static MemoryBudget &
+    instance();
+
+    /**
+     * @param bytes Limit of the FIFO bytes of the process, 0 for none.
+     */
+    void
+    set_limit(size_t bytes)
+    {
+        m_limit = bytes;
+    }
+
+    size_t
+    limit() const
+    {
+        return m_limit;
+    }
+
+    size_t
+    used() const
+    {
+        return m_used;
+    }
+
+    /**
+     * @brief Largest value reached by used().
+     */
+    size_t
+    high_water() const
+    {
+        return m_high_water;
+    }
+
+    /**
+     * @brief Bytes that can still be stored, SIZE_MAX without limit.
+     */
+    size_t
+    room() const
+    {
+        size_t limit = m_limit, used = m_used;
+        if(limit == 0)
+            return SIZE_MAX;
+        return used < limit ? limit - used : 0;
+    }
+
+    /**
+     * @brief Account for bytes stored (delta > 0) or released (delta < 0).
+     */
+    void
+    add(long delta);
+
+    private:
+    std::atomic<size_t> m_limit{0};
+    std::atomic<size_t> m_used{0};
+    std::atomic<size_t> m_high_water{0};
+};
+
+/**
+ * @brief Counters of a receive FIFO.
+ */
+struct FifoStats
+{
+    size_t size = 0;       ///< Bytes held.
+    size_t high_water = 0; ///< Largest size reached.
+    uint64_t dropped = 0;  ///< Bytes dropped by the limits.
+    uint64_t pauses = 0;   ///< Times the reading of the socket was paused.
+};
+
+/**
+ * @brief Bound of the receive FIFO of each client of a server. The limit
+ * is reached at capacity bytes, or when the FIFOs of the process hold the
+ * MemoryBudget limit.
+ */
+struct FifoLimits
+{
+    enum Policy
+    {
+        /// Stop reading the socket until the FIFO is back under the low
+        /// watermark (TCP: the receive window closes and the sender waits).
+        PAUSE,
+        DROP_OLDEST, ///< Discard the oldest bytes of the FIFO.
+        DROP_NEWEST, ///< Discard the received bytes that do not fit.
+        DISCONNECT   ///< Close the connection (UDP: forget the sender).
+    };
+
+    size_t capacity = 0;      ///< Bytes, 0 for no limit but the budget.
+    size_t low_watermark = 0; ///< PAUSE: resume under it, 0 for capacity/2.
+    Policy policy = PAUSE;
+
+    /**
+     * @brief What to do with n received bytes.
+     */
+    struct Admission
+    {
+        size_t drop_oldest = 0; ///< Bytes to consume from the FIFO first.
+        size_t store = 0;       ///< Bytes of the chunk to push.
+        bool pause = false;     ///< Stop reading the socket.
+        bool disconnect = false;
+    };
+
+    /**
+     * @param size Bytes held by the FIFO.
+     * @param n Bytes received.
+     * @param can_pause False when the socket cannot be paused (datagrams):
+     * PAUSE then drops the newest bytes.
+     */
+    Admission
+    admit(size_t size, size_t n, bool can_pause = true) const;
+
+    /**
+     * @brief True once a paused FIFO of size bytes can be read again. A
+     * FIFO paused by the budget resumes on the same watermark: its reader is
+     * the one that frees the memory.
+     */
+    bool
+    can_resume(size_t size) const
+    {
+        return size <= resume_watermark();
+    }
+
+    size_t
+    resume_watermark() const
+    {
+        return low_watermark ? low_watermark : capacity / 2;
+    }
+
+    /**
+     * @brief True if a FIFO read by a Framer can always complete a frame of
+     * frame_size bytes. The framer only consumes whole frames: a FIFO
+     * holding the start of one must not be full, and must be able to resume
+     * from a pause. DROP_OLDEST never fits, it would cut the frame the
+     * framer is parsing.
+     */
+    bool
+    fits(size_t frame_size) const
+    {
+        if(policy == DROP_OLDEST)
+            return false;
+        if(capacity == 0)
+            return true;
+        return capacity >= frame_size &&
+               (policy != PAUSE || resume_watermark() >= frame_size);
+    }
+};
+
+} // namespace Communication
+
+#endif // __FIFO_LIMITS_HPP__
@@ -0,0 +1,150 @@
+#ifndef __FRAMER_HPP__
+#define __FRAMER_HPP__
+
+#include "crc16.hpp"
+#include "ring_buffer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Communication
+{
+
+/**
+ * @brief Cuts a byte stream into whole frames.
+ *
+ * Three framings are supported:
+ * - fixed: every frame is size bytes long on the wire.
+ * - length prefix: a width bytes unsigned header gives the number of payload
+ *   bytes that follow it.
+ * - delimiter: the frame ends with a byte sequence.
+ *
+ * With a CRC, the two trailer bytes (see set_crc()) follow the protected
+ * bytes: [header][payload][CRC] (the CRC covers the header too) or
+ * [payload][CRC][delimiter]. The header, CRC and delimiter are stripped from
+ * the frames given back.
+ *
+ * Frames are read from a RingBuffer. A frame lying contiguously in it is
+ * given back in place (no copy), a frame wrapping around the end of the
+ * buffer is copied once into an internal buffer.
+ * A Framer keeps the scan state of one stream, use one copy per stream.
+ */
+class Framer
+{
+    public:
+    enum Mode
+    {
+        FIXED,
+        LENGTH_PREFIX,
+        DELIMITER
+    };
+
+    enum Status
+    {
+        INCOMPLETE, ///< More bytes are needed, nothing was consumed.
+        FRAME,      ///< A valid frame was consumed.
+        BAD_CRC,    ///< A frame was consumed but its CRC is wrong.
+        OVERSIZED   ///< The frame exceeds max_size, the stream is lost.
+    };
+
+    /**
+     * @param size Size of the frames on the wire, CRC included.
+     * @param has_crc The two last bytes are a CRC.
+     */
+    static Framer
+    fixed(size_t size, bool has_crc = false);
+
+    /**
+     * @param width Size of the length header (1, 2, 4 or 8 bytes).
+     * @param big_endian Byte order of the header.
+     * @param has_crc A CRC follows the payload.
+     * @param max_size Largest payload accepted.
+     */
+    static Framer
+    length_prefix(int width = 2,
+                  bool big_endian = true,
+                  bool has_crc = false,
+                  size_t max_size = 65536);
+
+    /**
+     * @param delimiter Byte sequence ending each frame. It must not appear in
+     * the payload (nor in the CRC).
+     * @param has_crc A CRC precedes the delimiter.
+     * @param max_size Largest frame accepted, delimiter included.
+     */
+    static Framer
+    delimiter(const std::string &delimiter,
+              bool has_crc = false,
+              size_t max_size = 65536);
+
+    /**
+     * @brief Select the CRC variant (default CRC16_XMODEM).
+     */
+    Framer &
+    set_crc(const CRCSpec &spec)
+    {
+        m_crc = spec;
+        return *this;
+    }
+
+    /**
+     * @brief Extract the frame at the front of a FIFO.
+     * @param fifo Received bytes.
+     * @param frame Set to the payload of the frame. It points in the FIFO or
+     * in the Framer and stays valid until the FIFO or the Framer is modified.
+     * @param size Set to the size of the payload.
+     * @return FRAME, INCOMPLETE, BAD_CRC or OVERSIZED (see Status).
+     */
+    Status
+    next(RingBuffer &fifo, const uint8_t *&frame, size_t &size);
+
+    /**
+     * @brief Forget the scan state, to be called when the FIFO is cleared.
+     */
+    void
+    reset()
+    {
+        m_scanned = 0;
+    }
+
+    Mode
+    mode() const
+    {
+        return m_mode;
+    }
+
+    /**
+     * @brief Largest number of bytes a frame can take on the wire.
+     */
+    size_t
+    max_wire_size() const;
+
+    protected:
+    Framer(Mode mode, bool has_crc, size_t max_size)
+        : m_mode(mode), m_has_crc(has_crc), m_max_size(max_size)
+    {
+    }
+
+    /**
+     * @brief Size on the wire of the frame at the front of the FIFO.
+     * @return 0 if the frame is incomplete, npos if it is oversized.
+     */
+    size_t
+    wire_size(const RingBuffer &fifo);
+
+    Mode m_mode;
+    bool m_has_crc;
+    size_t m_max_size;
+    size_t m_size = 0;        // FIXED
+    int m_width = 0;          // LENGTH_PREFIX
+    bool m_big_endian = true; // LENGTH_PREFIX
+    std::string m_delimiter;  // DELIMITER
+    size_t m_scanned = 0;     // DELIMITER: bytes already searched
+    CRCSpec m_crc = CRC16_XMODEM::spec();
+    std::vector<uint8_t> m_scratch;
+};
+
+} // namespace Communication
+
+#endif // __FRAMER_HPP__
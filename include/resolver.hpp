@@ -0,0 +1,118 @@
+#ifndef __RESOLVER_HPP__
+#define __RESOLVER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <sys/socket.h>
+#endif
+
+namespace Communication
+{
+
+/**
+ * @brief Addresses of a host name.
+ */
+struct Resolution
+{
+    std::vector<sockaddr_storage> addrs; ///< In getaddrinfo() order, port 0.
+    std::string error;                   ///< Empty on success.
+
+    /**
+     * @brief Copy of the addresses with the port set.
+     * @param family AF_INET or AF_INET6 to keep one family, AF_UNSPEC for all.
+     */
+    std::vector<sockaddr_storage>
+    with_port(int port, int family = AF_UNSPEC) const;
+};
+
+/**
+ * @brief Thread-safe name resolution built on getaddrinfo(), with a TTL
+ * bounded in-process cache shared by the TCP, UDP and HTTP clients.
+ *
+ * Concurrent lookups of the same name share one getaddrinfo() call. An
+ * expired entry is still served while a background lookup refreshes it, so
+ * reconnections never wait on the DNS once a name was resolved; a failed
+ * refresh keeps the last good addresses. Failures are cached for a shorter
+ * time. Numeric addresses bypass the cache.
+ */
+class Resolver
+{
+    public:
+    /**
+     * @brief Process-wide resolver used by the clients.
+     */
+    static Resolver &
+    instance();
+
+    /**
+     * @param ttl_s Time an answer is fresh, in seconds.
+     * @param negative_ttl_s Time a failure is remembered, in seconds.
+     */
+    Resolver(int ttl_s = 60, int negative_ttl_s = 5);
+
+    /**
+     * @brief Resolve a name, blocking on the lookup only on a cache miss.
+     * @param socktype SOCK_STREAM or SOCK_DGRAM.
+     */
+    Resolution
+    resolve(const std::string &host, int socktype = SOCK_STREAM);
+
+    /**
+     * @brief Resolve a name in the background. The future is ready at once
+     * on a cache hit.
+     */
+    std::shared_future<Resolution>
+    resolve_async(const std::string &host, int socktype = SOCK_STREAM);
+
+    void
+    set_ttl(int ttl_s, int negative_ttl_s = 5);
+
+    /**
+     * @brief Forget every cached answer.
+     */
+    void
+    clear();
+
+    /**
+     * @brief Number of lookups answered from the cache.
+     */
+    uint64_t
+    hits() const;
+
+    /**
+     * @brief Number of lookups that had to wait for getaddrinfo().
+     */
+    uint64_t
+    misses() const;
+
+    protected:
+    struct Cache;
+
+    /**
+     * @brief Start a lookup in a background thread, or join the one in
+     * progress for the same key. cache->mutex must be held.
+     */
+    static std::shared_future<Resolution>
+    start_lookup(const std::shared_ptr<Cache> &cache,
+                 const std::string &key,
+                 const std::string &host,
+                 int socktype);
+
+    // shared with the lookup threads, which can outlive the resolver
+    std::shared_ptr<Cache> m_cache;
+};
+
+} // namespace Communication
+
+#endif // __RESOLVER_HPP__
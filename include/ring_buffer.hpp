@@ -0,0 +1,160 @@
+#ifndef __RING_BUFFER_HPP__
+#define __RING_BUFFER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Communication
+{
+
+/**
+ * @brief Contiguous byte FIFO with a power-of-two capacity.
+ *
+ * Data is pushed and popped in bulk with at most two memcpy per call (the
+ * buffer wraps around at most once). The capacity doubles when a push does
+ * not fit, up to max_capacity; past that point push() only stores what fits.
+ * The class is not thread-safe, the owner is in charge of the locking.
+ */
+class RingBuffer
+{
+    public:
+    static const size_t npos = SIZE_MAX;
+
+    /**
+     * @param capacity Initial capacity, rounded up to a power of two.
+     * @param max_capacity Capacity the buffer is allowed to grow to (0 to
+     * never grow).
+     */
+    RingBuffer(size_t capacity = 4096, size_t max_capacity = SIZE_MAX);
+
+    /**
+     * @brief Append n bytes, growing the buffer if needed and allowed.
+     * @return Number of bytes stored (less than n if the buffer is full).
+     */
+    size_t
+    push(const uint8_t *data, size_t n);
+
+    /**
+     * @brief Copy and remove up to n bytes from the front of the buffer.
+     * @return Number of bytes copied.
+     */
+    size_t
+    pop(uint8_t *data, size_t n);
+
+    /**
+     * @brief Copy up to n bytes starting offset bytes after the front,
+     * without removing them.
+     * @return Number of bytes copied.
+     */
+    size_t
+    peek(uint8_t *data, size_t n, size_t offset = 0) const;
+
+    /**
+     * @brief Look for a byte sequence, starting offset bytes after the front.
+     * @return Offset of the first occurrence from the front, npos if the
+     * sequence is not in the buffer.
+     */
+    size_t
+    find(const uint8_t *pattern, size_t n, size_t offset = 0) const;
+
+    /**
+     * @brief Remove up to n bytes from the front of the buffer.
+     * @return Number of bytes removed.
+     */
+    size_t
+    consume(size_t n);
+
+    /**
+     * @brief Pointer to the first contiguous readable segment.
+     * @param n Set to the length of the segment.
+     */
+    const uint8_t *
+    read_ptr(size_t &n) const;
+
+    /**
+     * @brief Pointer to the first contiguous writable segment, to receive
+     * data in place. Validate the written bytes with commit().
+     * @param n Set to the length of the segment.
+     */
+    uint8_t *
+    write_ptr(size_t &n);
+
+    /**
+     * @brief Mark n bytes written through write_ptr() as readable.
+     */
+    void
+    commit(size_t n);
+
+    /**
+     * @brief Make room for at least n more bytes (within max_capacity).
+     * @return True if n bytes can be pushed without dropping data.
+     */
+    bool
+    reserve(size_t n);
+
+    void
+    clear()
+    {
+        m_head = m_tail = 0;
+    }
+
+    size_t
+    size() const
+    {
+        return m_tail - m_head;
+    }
+
+    bool
+    empty() const
+    {
+        return m_tail == m_head;
+    }
+
+    size_t
+    capacity() const
+    {
+        return m_data.size();
+    }
+
+    /**
+     * @brief Free space before the buffer has to grow.
+     */
+    size_t
+    available() const
+    {
+        return capacity() - size();
+    }
+
+    size_t
+    max_capacity() const
+    {
+        return m_max_capacity;
+    }
+
+    void
+    set_max_capacity(size_t max_capacity);
+
+    /**
+     * @brief Byte at offset from the front (offset < size()).
+     */
+    uint8_t
+    operator[](size_t offset) const
+    {
+        return m_data[(m_head + offset) & m_mask];
+    }
+
+    private:
+    void
+    grow(size_t min_capacity);
+
+    std::vector<uint8_t> m_data;
+    size_t m_mask;
+    size_t m_max_capacity;
+    size_t m_head = 0; // read position, wraps with m_mask
+    size_t m_tail = 0; // write position, m_tail - m_head = size
+};
+
+} // namespace Communication
+
+#endif // __RING_BUFFER_HPP__
@@ -0,0 +1,179 @@
+#ifndef __SEND_QUEUE_HPP__
+#define __SEND_QUEUE_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Communication
+{
+
+/**
+ * @brief Immutable buffer, shared by the send queues it is pushed to.
+ */
+typedef std::shared_ptr<const std::vector<uint8_t>> SharedBuffer;
+
+/**
+ * @brief Make a SharedBuffer holding a copy of size bytes.
+ */
+SharedBuffer
+make_shared_buffer(const void *data, size_t size);
+
+/**
+ * @brief Outgoing queue of a stream socket, drained without blocking.
+ *
+ * The queue holds references to shared buffers: a message pushed to many
+ * queues is stored once. drain() sends the head of the queue with one
+ * vectored sendmsg() and keeps what the socket did not take for the next
+ * call. When a push would take the queue over its byte limit, the policy of
+ * the queue decides what happens to the slow consumer.
+ *
+ * A message can carry a completion callback. The callbacks of the messages
+ * sent or dropped are collected under the lock and called by complete(),
+ * which the owner calls once it released its own locks.
+ * The class is thread-safe.
+ */
+class SendQueue
+{
+    public:
+    /**
+     * @param sent True once the whole message was handed to the socket,
+     * false if it was dropped (limit, closed connection).
+     */
+    typedef void (*Callback)(void *data, bool sent);
+
+    enum Policy
+    {
+        DROP,       ///< Drop the new message.
+        DISCONNECT, ///< Drop the new message, the owner closes the socket.
+        COALESCE    ///< Drop the queued messages not started, keep the new one.
+    };
+
+    enum Status
+    {
+        QUEUED,
+        DROPPED,
+        OVERFLOW ///< Dropped, DISCONNECT policy: close the socket.
+    };
+
+    /**
+     * @param limit Maximum number of queued bytes (a message larger than the
+     * limit is still queued when the queue is empty).
+     */
+    SendQueue(size_t limit = 4 * 1024 * 1024, Policy policy = DROP)
+        : m_limit(limit), m_policy(policy)
+    {
+    }
+
+    void
+    set_limit(size_t limit, Policy policy)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_limit = limit;
+        m_policy = policy;
+    }
+
+    /**
+     * @brief Queue a buffer behind the bytes already queued.
+     * @param callback Called by complete() once the buffer is sent or
+     * dropped, may be null.
+     */
+    Status
+    push(SharedBuffer buffer,
+         Callback callback = nullptr,
+         void *data = nullptr);
+
+    /**
+     * @brief Send as much of the queue as the socket takes without blocking.
+     * @return Number of bytes sent, -1 if the socket failed (the queue is
+     * then cleared).
+     */
+    long
+    drain(int fd);
+
+    /**
+     * @brief Drop the queued bytes.
+     */
+    void
+    clear();
+
+    /**
+     * @brief Call the callbacks of the messages sent or dropped so far. Not
+     * to be called with a lock the callbacks may take.
+     */
+    void
+    complete();
+
+    /**
+     * @brief Wait until the queue is empty.
+     * @return false if bytes are still queued at the deadline.
+     */
+    bool
+    wait_empty(std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * @brief Number of bytes queued and not sent yet.
+     */
+    size_t
+    backlog() const
+    {
+        return m_bytes;
+    }
+
+    bool
+    empty() const
+    {
+        return m_bytes == 0;
+    }
+
+    /**
+     * @brief Number of messages dropped by the limit.
+     */
+    uint64_t
+    dropped() const
+    {
+        return m_dropped;
+    }
+
+    protected:
+    struct Segment
+    {
+        SharedBuffer buffer;
+        size_t offset; // bytes already sent
+        Callback callback;
+        void *data;
+    };
+
+    /**
+     * @brief Hand the callback of a segment to complete(). m_mutex must be
+     * held.
+     */
+    void
+    done(const Segment &segment, bool sent);
+
+    struct Completion
+    {
+        Callback callback;
+        void *data;
+        bool sent;
+    };
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_empty_cv;
+    std::deque<Segment> m_segments;
+    std::vector<Completion> m_done; // for complete()
+    std::atomic<size_t> m_bytes{0};
+    std::atomic<uint64_t> m_dropped{0};
+    size_t m_limit;
+    Policy m_policy;
+};
+
+} // namespace Communication
+
+#endif // __SEND_QUEUE_HPP__
@@ -0,0 +1,67 @@
+#ifndef __SOCKET_PROFILE_HPP__
+#define __SOCKET_PROFILE_HPP__
+
+#include <string>
+
+namespace Communication
+{
+
+/**
+ * @brief Set of socket options applied the same way to the TCP/UDP clients
+ * and to the server sockets (accepted TCP sockets included).
+ *
+ * Every field is -1 to keep the kernel default. Options the platform does
+ * not know are skipped, options the kernel refuses (e.g. SO_BUSY_POLL
+ * without CAP_NET_ADMIN) are left as they are: read the applied values
+ * back with query().
+ */
+struct SocketProfile
+{
+    int rcvbuf = -1;        ///< SO_RCVBUF, bytes.
+    int sndbuf = -1;        ///< SO_SNDBUF, bytes.
+    int nodelay = -1;       ///< TCP_NODELAY (1 disables Nagle).
+    int quickack = -1;      ///< TCP_QUICKACK, re-armed after every read.
+    int notsent_lowat = -1; ///< TCP_NOTSENT_LOWAT, bytes.
+    int busy_poll = -1;     ///< SO_BUSY_POLL, microseconds.
+    int priority = -1;      ///< SO_PRIORITY (0-6 without CAP_NET_ADMIN).
+    int tos = -1;           ///< IP_TOS / IPV6_TCLASS.
+    int rcvlowat = -1;      ///< SO_RCVLOWAT, bytes.
+
+    /**
+     * @brief No Nagle, immediate ACKs, small unsent queue, busy polling and
+     * low-delay TOS for request/response traffic.
+     */
+    static SocketProfile
+    low_latency();
+
+    /**
+     * @brief Large buffers and throughput TOS for streaming.
+     */
+    static SocketProfile
+    bulk_throughput();
+
+    /**
+     * @brief Set the options of the profile on a socket (the TCP ones only
+     * on stream sockets). Nothing is done for a profile with no option set.
+     */
+    void
+    apply(int fd) const;
+
+    /**
+     * @brief Read the current value of every option of a socket (-1 for the
+     * ones the platform or the socket type does not support). SO_RCVBUF and
+     * SO_SNDBUF are reported as the kernel sizes them (doubled on Linux).
+     */
+    static SocketProfile
+    query(int fd);
+
+    /**
+     * @brief "name=value" list of the options that are set, e.g. for logs.
+     */
+    std::string
+    to_string() const;
+};
+
+} // namespace Communication
+
+#endif // __SOCKET_PROFILE_HPP__
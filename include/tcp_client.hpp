@@ -2,14 +2,19 @@
 #define __TCP_CLIENT_HPP__
 
 #include "com_client.hpp"
-#include <algorithm> // for std::copy
+#include "uring.hpp"
+#include <algorithm>
+#include <condition_variable>
 #include <cstring>
 #include <deque>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <netinet/tcp.h>
+#include <set>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 namespace Communication
 {
@@ -19,6 +24,39 @@ class TCP : public Client
     TCP(int verbose = -1);
     ~TCP() {};
 
+    struct Endpoint
+    {
+        std::string address;
+        int port;
+    };
+
+    /**
+     * @brief Outcome of the connection to one endpoint of connect_all().
+     */
+    struct ConnectResult
+    {
+        std::unique_ptr<TCP> client; ///< Connected client, null on failure.
+        std::string error;           ///< Reason of the failure.
+    };
+
+    /**
+     * @brief Connect to many endpoints in parallel. All the connects are
+     * started non-blocking and waited for together under one poll(), so the
+     * whole batch takes at most timeout_ms whatever the number of endpoints
+     * down. When a name resolves to several addresses they are raced happy
+     * eyeballs style (RFC 8305): families alternate, the next address is
+     * tried when the previous attempt fails or after 250 ms, the first
+     * connected wins.
+     * @param endpoints Addresses (names or IPv4/IPv6) and ports.
+     * @param timeout_ms Deadline of the whole batch.
+     * @param verbose Verbosity of the created clients.
+     * @return One result per endpoint, in the same order.
+     */
+    static std::vector<ConnectResult>
+    connect_all(const std::vector<Endpoint> &endpoints,
+                int timeout_ms,
+                int verbose = -1);
+
     /**
      * @brief open_connection Open the connection the serial or network or interface
      * @param address Path or IP address
@@ -53,6 +91,15 @@ class TCP : public Client
     int
     writeS(const void *buffer, size_t size, bool add_crc = false);
 
+    /**
+     * @brief Zero-copy write, see Client::write_zerocopy().
+     */
+    int
+    write_zerocopy(const void *buffer,
+                   size_t size,
+                   uint64_t *id = nullptr,
+                   bool add_crc = false) override;
+
     protected:
     std::string m_ip;
     /* data */
@@ -88,13 +135,25 @@ class TCPServer : public Server
         if(!m_is_running)
             return;
         m_is_running = false;
-        logln("Waiting for threads to join", true);
-        for(auto &thread : m_threads)
-            if(thread.second.joinable())
-                thread.second.join();
+        // release the readers blocked in read_byte()
+        m_connections.for_each(
+            [](SOCKET, std::shared_ptr<Connection> &c)
+            {
+                std::lock_guard<std::mutex> lock(c->mutex);
+                c->open = false;
+                c->cv.notify_all();
+            });
+        // the accept thread owns m_threads, stop it first
         logln("Waiting for accept thread to join", true);
         if(m_accept_thread.joinable())
             m_accept_thread.join();
+        logln("Waiting for threads to join", true);
+        for(ClientThread &client : m_threads)
+            if(client.thread.joinable())
+                client.thread.join();
+        m_threads.clear();
+        stop_writer();
+        stop_engine();
         // if(!m_is_running)
         //     return;
         //wait for the threads to finish
@@ -103,73 +162,634 @@ class TCPServer : public Server
         Server::stop();
     }
 
+    /**
+     * @brief Sockets of the connected clients. The list is rebuilt only
+     * after a connection or a disconnection, and taking it never waits for
+     * the I/O threads.
+     */
+    Snapshot<SOCKET>
+    get_clients() override
+    {
+        return m_connections.snapshot();
+    }
+
+    protected:
+    struct Connection;
+
+    public:
+    /**
+     * @brief Reference to the state of one client, to send and read without
+     * looking the socket up: the calls taking a Handle are O(1).
+     *
+     * A handle keeps the state alive. Once the client is gone the handle is
+     * stale and the calls fail, even if its socket number was given to a new
+     * client: each connection has its own generation number.
+     */
+    class Handle
+    {
+        public:
+        Handle() = default;
+
+        /**
+         * @brief False once the client disconnected or was removed.
+         */
+        bool
+        valid() const
+        {
+            return m_c && m_c->open;
+        }
+
+        SOCKET
+        socket() const
+        {
+            return m_c ? m_c->socket : INVALID_SOCKET;
+        }
+
+        /**
+         * @brief Number of the connection among all the connections of the
+         * server (from 1), 0 for an empty handle.
+         */
+        uint64_t
+        generation() const
+        {
+            return m_c ? m_c->generation : 0;
+        }
+
+        bool
+        operator==(const Handle &other) const
+        {
+            return m_c == other.m_c;
+        }
+        bool
+        operator!=(const Handle &other) const
+        {
+            return m_c != other.m_c;
+        }
+
+        private:
+        friend class TCPServer;
+        explicit Handle(std::shared_ptr<Connection> c) : m_c(std::move(c)) {}
+        std::shared_ptr<Connection> m_c;
+    };
+
+    /**
+     * @brief Handle of a connected client, e.g. from the new client callback.
+     * @return An empty (invalid) handle if the client is unknown.
+     */
+    Handle
+    get_handle(SOCKET s)
+    {
+        return Handle(get_connection(s));
+    }
+
+    /**
+     * @brief Sharded REACTOR engine (Linux): n listening sockets bound to the
+     * port with SO_REUSEPORT, each served by its own epoll thread that
+     * accepts and serves its connections. The kernel spreads the incoming
+     * connections over the shards; get_clients(), send_data() and the other
+     * calls see the clients of all of them. Must be called before start().
+     * @param pin Pin shard i to the i-th CPU the process may run on.
+     */
+    void
+    set_shards(int n_shards, bool pin = true)
+    {
+        set_engine(REACTOR, n_shards);
+        m_n_shards = m_n_io_threads;
+        m_pin_shards = pin;
+    }
+
+    /**
+     * @brief Number of connections accepted by each shard.
+     */
+    std::vector<uint64_t>
+    shard_accepts() const
+    {
+        std::vector<uint64_t> accepts;
+        if(m_shard_accepts)
+            for(int i = 0; i < m_n_shards; i++)
+                accepts.push_back(m_shard_accepts[i]);
+        return accepts;
+    }
+
+    /**
+     * @brief Coalesce the small messages given to send_data() (see
+     * Coalescer). Must be called before start().
+     * @param budget_us Latency budget of a message, in microseconds.
+     * @param threshold Number of queued bytes that triggers a send.
+     */
+    void
+    set_coalescing(int budget_us = 50, size_t threshold = 16 * 1024)
+    {
+        if(m_is_running)
+            throw log_error("Cannot enable coalescing on a running server");
+        m_tx_budget_us = budget_us;
+        m_tx_threshold = threshold;
+    }
+
+    /**
+     * @brief Send a buffer to a client without blocking. The buffer is
+     * copied to the send queue of the client (see SendQueue), which is sent
+     * right away as far as the socket takes it and then by an I/O thread
+     * when the socket is writable: EPOLLOUT with the REACTOR engine, a
+     * writer thread otherwise. In coalescing mode the buffer goes to the
+     * coalescer instead.
+     * @param callback Called when the buffer was sent or dropped, with
+     * data, possibly from an I/O thread.
+     * @return 0, -1 if the handle is stale or the buffer was dropped (see
+     * set_send_queue()).
+     */
     int
-    send_data(const void *buffer, size_t size, SOCKET s)
+    send_data(const void *buffer,
+              size_t size,
+              const Handle &h,
+              SendQueue::Callback callback = nullptr,
+              void *data = nullptr)
     {
-        for(auto &client : m_clients)
-            if(client == s)
-            {
-                std::lock_guard<std::mutex> lock(m_mutexes[s]);
-                send(client, buffer, size, 0);
-            }
-        return 0;
+        Connection *c = h.m_c.get();
+        if(h.valid() && c->tx && c->txq.empty() && !callback)
+            return c->tx->write(buffer, size) < 0 ? -1 : 0;
+        return send_data(make_shared_buffer(buffer, size), h, callback, data);
+    }
+    int
+    send_data(const void *buffer,
+              size_t size,
+              SOCKET s,
+              SendQueue::Callback callback = nullptr,
+              void *data = nullptr)
+    {
+        return send_data(buffer, size, get_handle(s), callback, data);
+    }
+    /**
+     * @brief Same, without the copy.
+     */
+    int
+    send_data(SharedBuffer buffer,
+              const Handle &h,
+              SendQueue::Callback callback = nullptr,
+              void *data = nullptr)
+    {
+        if(!h.valid())
+        {
+            if(callback)
+                callback(data, false);
+            return -1;
+        }
+        return enqueue(h.m_c, std::move(buffer), callback, data) ? 0 : -1;
+    }
+
+    /**
+     * @brief Wait until everything queued for a client is sent.
+     * @return false if the client is unknown or bytes are left at the
+     * deadline.
+     */
+    bool
+    flush(const Handle &h, std::chrono::steady_clock::time_point deadline)
+    {
+        if(!h.valid())
+            return false;
+        if(h.m_c->tx && h.m_c->tx->flush() < 0)
+            return false;
+        return h.m_c->txq.wait_empty(deadline) && h.valid();
+    }
+    bool
+    flush(SOCKET s, std::chrono::steady_clock::time_point deadline)
+    {
+        return flush(get_handle(s), deadline);
+    }
+
+    /**
+     * @brief Limit of the send queue of each client, and what to do with a
+     * client whose queue is full (see SendQueue::Policy). Must be called
+     * before start().
+     */
+    void
+    set_send_queue(size_t limit, SendQueue::Policy policy = SendQueue::DROP)
+    {
+        if(m_is_running)
+            throw log_error("Cannot change the send queues of a running server");
+        m_txq_limit = limit;
+        m_txq_policy = policy;
     }
 
-    int8_t
+    /**
+     * @brief Send a buffer to every client. It is copied once and its
+     * reference is queued for each client: a client whose socket buffer is
+     * full gets the rest later, from a writer thread, without delaying the
+     * others. A client over its queue limit is handled as set_send_queue()
+     * says.
+     */
+    void
+    broadcast(const void *buffer, size_t size) override
+    {
+        broadcast(make_shared_buffer(buffer, size));
+    }
+    /**
+     * @brief Same, without the copy.
+     * @return Number of clients the buffer was queued for.
+     */
+    size_t
+    broadcast(SharedBuffer buffer)
+    {
+        std::vector<std::shared_ptr<Connection>> clients;
+        clients.reserve(m_connections.size());
+        m_connections.for_each([&](SOCKET, std::shared_ptr<Connection> &c)
+                               { clients.push_back(c); });
+        size_t queued = 0;
+        for(std::shared_ptr<Connection> &c : clients)
+            queued += enqueue(c, buffer);
+        return queued;
+    }
+
+    /**
+     * @brief Number of bytes queued for a client and not sent yet.
+     */
+    size_t
+    send_backlog(const Handle &h)
+    {
+        return h.m_c ? h.m_c->txq.backlog() : 0;
+    }
+    size_t
+    send_backlog(SOCKET s)
+    {
+        return send_backlog(get_handle(s));
+    }
+
+    /**
+     * @brief Number of messages to a client dropped by its queue limit.
+     */
+    uint64_t
+    send_dropped(const Handle &h)
+    {
+        return h.m_c ? h.m_c->txq.dropped() : 0;
+    }
+    uint64_t
+    send_dropped(SOCKET s)
+    {
+        return send_dropped(get_handle(s));
+    }
+
+    /**
+     * @brief Let send_zerocopy() send the buffers of at least threshold bytes
+     * without copying them (see ZeroCopy). Must be called before start().
+     */
+    void
+    set_zerocopy(size_t threshold = 16 * 1024)
+    {
+        if(m_is_running)
+            throw log_error("Cannot enable zero-copy on a running server");
+        m_zc_threshold = threshold;
+    }
+
+    /**
+     * @brief Send a buffer to a client without copying it, if set_zerocopy()
+     * was called and the buffer is large enough (send_data() otherwise).
+     * Never blocks: what the socket does not take is copied to the send
+     * queue of the client.
+     * @param id Set to the id to give to zerocopy_done() before the buffer
+     * is modified or freed, 0 when the buffer was copied.
+     * @return size, -1 on error or if the client is unknown.
+     */
+    int
+    send_zerocopy(const void *buffer,
+                  size_t size,
+                  const Handle &h,
+                  uint64_t *id = nullptr)
+    {
+        if(id)
+            *id = 0;
+        Connection *c = h.m_c.get();
+        if(!h.valid())
+            return -1;
+        // behind queued messages the buffer is queued too, copied
+        if(!c->zc || !c->txq.empty())
+            return send_data(buffer, size, h) < 0 ? -1 : (int)size;
+        if(c->tx)
+            c->tx->flush(); // keep the order of the messages
+        int n = c->zc->send(buffer, size, id);
+        if(n < 0 || (size_t)n == size)
+            return n;
+        // the socket is full, a part of a message left out would break the
+        // stream: queue the rest
+        enqueue(h.m_c, make_shared_buffer((const uint8_t *)buffer + n,
+                                          size - n));
+        return (int)size;
+    }
+    int
+    send_zerocopy(const void *buffer,
+                  size_t size,
+                  SOCKET s,
+                  uint64_t *id = nullptr)
+    {
+        return send_zerocopy(buffer, size, get_handle(s), id);
+    }
+
+    /**
+     * @brief Tell whether the buffer of a send_zerocopy() can be reused. The
+     * buffers sent to a client that disconnected are done.
+     * @param timeout_ms Time to wait for the completion (0 to only check, -1
+     * to wait until it comes).
+     */
+    bool
+    zerocopy_done(const Handle &h, uint64_t id, int timeout_ms = 0)
+    {
+        Connection *c = h.m_c.get();
+        return !c || !c->zc || c->zc->wait(id, timeout_ms);
+    }
+    bool
+    zerocopy_done(SOCKET s, uint64_t id, int timeout_ms = 0)
+    {
+        return zerocopy_done(get_handle(s), id, timeout_ms);
+    }
+
+    /**
+     * @brief Send the messages queued for a client by the coalescing mode.
+     * @return Number of bytes sent, -1 on error or if the client is unknown.
+     */
+    int
+    flush(const Handle &h)
+    {
+        if(!h.valid())
+            return -1;
+        return h.m_c->tx ? h.m_c->tx->flush() : 0;
+    }
+    int
+    flush(SOCKET s)
+    {
+        return flush(get_handle(s));
+    }
+
+    /**
+     * @brief Read bytes received from a client.
+     * @param i Client socket.
+     * @param buffer Destination buffer.
+     * @param size Maximum number of bytes to read.
+     * @param blocking Wait until size bytes are available. The reader sleeps
+     * on the client condition variable and is woken by the receive side as
+     * soon as enough bytes are stored.
+     * @param erase Remove the bytes from the FIFO.
+     * @param timeout_ms Maximum time to wait in blocking mode (-1 to wait
+     * until the data arrives or the client disconnects).
+     * @return Number of bytes read (less than size on timeout or
+     * disconnection), -1 if the client is unknown (stale handle).
+     */
+    int
+    read_byte(const Handle &h,
+              uint8_t *buffer,
+              size_t size,
+              bool blocking = false,
+              bool erase = true,
+              int timeout_ms = -1)
+    {
+        Connection *c = h.m_c.get();
+        if(!h.valid())
+            return -1;
+
+        std::unique_lock<std::mutex> lock(c->mutex);
+        if(blocking)
+            wait_for_data(*c, lock, size, timeout_ms);
+        size = erase ? c->fifo.pop(buffer, size) : c->fifo.peek(buffer, size);
+        on_fifo_change(*c);
+        return size;
+    }
+    int
     read_byte(SOCKET i,
               uint8_t *buffer,
               size_t size,
               bool blocking = false,
-              bool erase = true)
+              bool erase = true,
+              int timeout_ms = -1)
     {
-        if(m_clients.find(i) == m_clients.end())
+        return read_byte(get_handle(i), buffer, size, blocking, erase,
+                         timeout_ms);
+    }
+
+    /**
+     * @brief Read a CRC protected frame from a client FIFO. The CRC (see
+     * set_crc()) is computed while the bytes are copied out of the FIFO, so
+     * the frame is only read once.
+     * @param i Client socket.
+     * @param buffer Destination buffer.
+     * @param size Size of the frame, CRC included.
+     * @param blocking Wait until size bytes are available.
+     * @param timeout_ms Maximum time to wait in blocking mode (-1 for none).
+     * @return size if the frame is valid, 0 if less than size bytes are
+     * available (nothing is consumed), -1 if the client is unknown or the
+     * CRC is wrong (the frame is consumed).
+     */
+    int
+    read_frame(const Handle &h,
+               uint8_t *buffer,
+               size_t size,
+               bool blocking = false,
+               int timeout_ms = -1)
+    {
+        Connection *c = h.m_c.get();
+        if(!h.valid() || size < 2)
             return -1;
 
-        size_t n_available = 0;
-        {
-            std::lock_guard<std::mutex> lock(m_mutexes[i]);
-            n_available = m_fifos[i].size();
-        }
-        if(blocking && n_available < size)
+        std::unique_lock<std::mutex> lock(c->mutex);
+        if(blocking)
+            wait_for_data(*c, lock, size, timeout_ms);
+        if(c->fifo.size() < size)
+            return 0;
+
+        // at most two contiguous segments when the frame wraps
+        CRCAccumulator crc(m_crc);
+        size_t body = size - 2;
+        for(size_t done = 0, len; done < size; done += len)
         {
-            do {
-                std::this_thread::sleep_for(
-                    std::chrono::milliseconds(1)); //wait 1ms
-                std::lock_guard<std::mutex> lock(m_mutexes[i]);
-                n_available = m_fifos[i].size();
-                if(n_available > size)
-                    break;
-            } while(n_available < size);
+            const uint8_t *src = c->fifo.read_ptr(len);
+            len = std::min(len, size - done);
+            size_t hashed = done < body ? std::min(len, body - done) : 0;
+            crc.update_copy(buffer + done, src, hashed);
+            memcpy(buffer + done + hashed, src + hashed, len - hashed);
+            c->fifo.consume(len);
         }
+        on_fifo_change(*c);
+        lock.unlock();
 
-        size = std::min(size, m_fifos[i].size());
-
+        if(!crc.verify(buffer + body))
         {
-            std::lock_guard<std::mutex> lock(m_mutexes[i]);
-            std::copy(m_fifos[i].begin(), m_fifos[i].begin() + size, buffer);
-            if(erase)
-                m_fifos[i].erase(m_fifos[i].begin(), m_fifos[i].begin() + size);
+            logln("CRC error", true);
+            return -1;
         }
         return size;
     }
+    int
+    read_frame(SOCKET i,
+               uint8_t *buffer,
+               size_t size,
+               bool blocking = false,
+               int timeout_ms = -1)
+    {
+        return read_frame(get_handle(i), buffer, size, blocking, timeout_ms);
+    }
+
+    /**
+     * @brief Cut the stream of every client into frames and call a callback
+     * per whole frame instead of the per chunk callback (see set_callback()).
+     * The FIFO of the clients then belongs to the framer, do not read it with
+     * read_byte() or read_frame(). Must be called before start().
+     * @param framer Framing of the streams, copied for each client.
+     * @param callback Called from the receive thread with the payload of each
+     * valid frame. The payload is only valid during the call.
+     * @param data User data given to the callback.
+     */
+    void
+    set_frame_callback(const Framer &framer,
+                       void (*callback)(Server *server,
+                                        const uint8_t *frame,
+                                        size_t size,
+                                        SOCKET client_socket,
+                                        void *data),
+                       void *data = nullptr)
+    {
+        if(m_is_running)
+            throw log_error("Cannot change the framing of a running server");
+        if(!m_fifo_limits.fits(framer.max_wire_size()))
+            throw log_error("The FIFO limits cannot keep whole frames");
+        m_framer.reset(new Framer(framer));
+        m_frame_callback = callback;
+        m_frame_callback_data = data;
+    }
+
+    /**
+     * @brief Same as Server::set_fifo_limits(), the limits must hold a whole
+     * frame of the framing set (see FifoLimits::fits()).
+     */
+    void
+    set_fifo_limits(const FifoLimits &limits) override
+    {
+        if(m_framer && !limits.fits(m_framer->max_wire_size()))
+            throw log_error("The FIFO limits cannot keep whole frames");
+        Server::set_fifo_limits(limits);
+    }
 
+    void
+    clear_fifo(const Handle &h)
+    {
+        Connection *c = h.m_c.get();
+        if(!h.valid())
+            return;
+        std::lock_guard<std::mutex> lock(c->mutex);
+        c->fifo.clear();
+        if(c->framer)
+            c->framer->reset();
+        on_fifo_change(*c);
+    }
+
+    /**
+     * @brief Size, high-water mark and drop counters of the FIFO of a client
+     * (see set_fifo_limits()).
+     */
+    FifoStats
+    fifo_stats(const Handle &h)
+    {
+        if(!h.m_c)
+            return FifoStats();
+        std::lock_guard<std::mutex> lock(h.m_c->mutex);
+        FifoStats stats = h.m_c->stats;
+        stats.size = h.m_c->fifo.size();
+        return stats;
+    }
+    FifoStats
+    fifo_stats(SOCKET s)
+    {
+        return fifo_stats(get_handle(s));
+    }
     void
     clear_fifo(SOCKET i)
     {
-        std::lock_guard<std::mutex> lock(m_mutexes[i]);
-        m_fifos[i].clear();
+        clear_fifo(get_handle(i));
+    }
+
+    /**
+     * @brief Timestamps of the oldest byte in the FIFO of a client (all 0 if
+     * the FIFO is empty or timestamping is disabled).
+     */
+    RxTimestamp
+    fifo_timestamp(const Handle &h)
+    {
+        Connection *c = h.m_c.get();
+        if(!h.valid())
+            return RxTimestamp();
+        std::lock_guard<std::mutex> lock(c->mutex);
+        prune_stamps(*c);
+        return c->stamps.empty() ? RxTimestamp() : c->stamps.front().second;
+    }
+    RxTimestamp
+    fifo_timestamp(SOCKET i)
+    {
+        return fifo_timestamp(get_handle(i));
     }
 
+    /**
+     * @return Number of bytes in the FIFO of a client, -1 if the client is
+     * unknown (stale handle).
+     */
     int
-    is_available(SOCKET i)
+    is_available(const Handle &h)
     {
-        if(m_clients.find(i) == m_clients.end())
+        Connection *c = h.m_c.get();
+        if(!h.valid())
             return -1;
-        std::lock_guard<std::mutex> lock(m_mutexes[i]);
-        return m_fifos[i].size();
+        std::lock_guard<std::mutex> lock(c->mutex);
+        return c->fifo.size();
+    }
+    int
+    is_available(SOCKET i)
+    {
+        return is_available(get_handle(i));
     }
 
     protected:
+    /**
+     * @brief Per client state. It is shared so that a reader blocked in
+     * read_byte() keeps it alive while the client is removed.
+     */
+    struct Connection : std::enable_shared_from_this<Connection>
+    {
+        TCPServer *server = nullptr;
+        RingBuffer fifo;
+        std::mutex mutex;
+        std::condition_variable cv;
+        SOCKET socket = INVALID_SOCKET;
+        uint64_t generation = 0; // see Handle
+        // bytes each blocked reader waits for, the smallest first
+        std::multiset<size_t> wanted;
+        std::atomic<bool> open{true}; // set under mutex
+        std::unique_ptr<Framer> framer; // see set_frame_callback()
+        std::unique_ptr<Coalescer> tx;  // see set_coalescing(), to txq
+        std::unique_ptr<ZeroCopy> zc;   // see set_zerocopy()
+        SendQueue txq;                  // see broadcast()
+        bool tx_pending = false;        // in m_tx_pending, under m_tx_mutex
+        int epoll_fd = -1;   // REACTOR engine, set once registered
+        bool tx_armed = false; // EPOLLOUT watched, under mutex
+        bool paused = false;   // reading stopped (FifoLimits::PAUSE)
+        // IO_URING engine, ring thread only: a multishot receive is armed,
+        // its cancellation was requested
+        bool uring_recv = false;
+        bool uring_cancel = false;
+        size_t accounted = 0;  // FIFO bytes counted in the MemoryBudget
+        FifoStats stats;
+        // RX timestamps of the chunks in the FIFO, by stream offset of their
+        // end (see set_timestamping())
+        uint64_t rx_total = 0;
+        std::deque<std::pair<uint64_t, RxTimestamp>> stamps;
+    };
+
+    /**
+     * @brief Forget the timestamps of the chunks read from the FIFO. The
+     * mutex of the connection must be held.
+     */
+    static void
+    prune_stamps(Connection &c)
+    {
+        uint64_t first_unread = c.rx_total - c.fifo.size();
+        while(!c.stamps.empty() && c.stamps.front().first <= first_unread)
+            c.stamps.pop_front();
+    }
+
     void
     listen_for_connections() override
     {
@@ -187,6 +807,15 @@ class TCPServer : public Server
             closesocket(m_fd);
             throw log_error("Failed to set socket option");
         }
+#ifdef SO_REUSEPORT
+        // the other shards bind the same port (see set_shards())
+        if(m_n_shards > 0 && setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT,
+                                        (const char *)&enable, sizeof(int)) < 0)
+        {
+            closesocket(m_fd);
+            throw log_error("Failed to set SO_REUSEPORT");
+        }
+#endif
 
         int flag = m_nagled ? 1 : 0;
         if(setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag,
@@ -199,6 +828,9 @@ class TCPServer : public Server
             throw log_error("Failed to set TCP_QUICKACK [" +
                             std::string(strerror(errno)) + "] on socket");
 
+        // inherited by the accepted sockets, applied again on them anyway
+        m_profile.apply(m_fd);
+
         // Set up the server address
         SOCKADDR_IN sin = {0, 0, 0, 0};
         sin.sin_family = AF_INET;
@@ -284,6 +916,11 @@ class TCPServer : public Server
         logln("TCP Server is listening on port " + std::to_string(m_port),
               true);
 
+        if(m_engine == REACTOR && start_reactor())
+            return;
+        if(m_engine == IO_URING && start_uring())
+            return;
+
         // Accept incoming connections
         // std::thread(&TCPServer::accept_connections, this).detach();
         m_accept_thread = std::thread(&TCPServer::accept_connections, this);
@@ -304,30 +941,18 @@ class TCPServer : public Server
         char buffer[1024];
         while(m_is_running)
         {
-            int bytes_received = recv(client_socket, buffer, sizeof(buffer), 0);
+            RxTimestamp ts;
+            int bytes_received =
+                m_timestamping ? Timestamping::recv(client_socket, buffer,
+                                                    sizeof(buffer), 0, ts)
+                               : recv(client_socket, buffer, sizeof(buffer), 0);
+            m_rx_syscalls++;
             if(bytes_received > 0)
             {
-                //lock the mutex
-                {
-                    std::lock_guard<std::mutex> lock(m_mutexes[client_socket]);
-                    m_fifos[client_socket].insert(m_fifos[client_socket].end(),
-                                                  buffer,
-                                                  buffer + bytes_received);
-                }
-
-                logln("Socket " + std::to_string(client_socket) +
-                          " received [" + std::to_string(bytes_received) +
-                          " bytes], size fifo: " +
-                          std::to_string(m_fifos[client_socket].size()),
-                      true);
-
-                if(m_callback)
-                {
-                    m_callback(this, reinterpret_cast<uint8_t *>(buffer),
-                               bytes_received,
-                               reinterpret_cast<void *>(&client_socket),
-                               m_callback_data);
-                }
+                if(!on_receive(client_socket,
+                               reinterpret_cast<uint8_t *>(buffer),
+                               bytes_received, ts))
+                    wait_resumed(client_socket);
             }
             else if(bytes_received == 0)
             {
@@ -360,20 +985,442 @@ class TCPServer : public Server
             }
         }
 
+        remove_client(client_socket);
+    }
+
+    /**
+     * @brief Wait until the FIFO of a client holds size bytes, the timeout
+     * expires or the client is closed. lock must hold c.mutex.
+     */
+    void
+    wait_for_data(Connection &c,
+                  std::unique_lock<std::mutex> &lock,
+                  size_t size,
+                  int timeout_ms)
+    {
+        if(c.fifo.size() >= size)
+            return;
+        auto ready = [&]() { return c.fifo.size() >= size || !c.open; };
+        // the receive side wakes the readers once the smallest wait is met
+        auto waiter = c.wanted.insert(size);
+        if(timeout_ms < 0)
+            c.cv.wait(lock, ready);
+        else
+            c.cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+        c.wanted.erase(waiter);
+    }
+
+    /**
+     * @brief Update the budget and the counters after the FIFO of a client
+     * changed, and read the client again once a paused FIFO is back under
+     * its low watermark. The mutex of the connection must be held.
+     */
+    void
+    on_fifo_change(Connection &c)
+    {
+        if(!c.open) // released by remove_client()
+            return;
+        size_t size = c.fifo.size();
+        MemoryBudget::instance().add((long)size - (long)c.accounted);
+        c.accounted = size;
+        c.stats.high_water = std::max(c.stats.high_water, size);
+        if(c.paused && m_fifo_limits.can_resume(size))
+        {
+            c.paused = false;
+            update_events(c);
+            c.cv.notify_all(); // THREADS engine, see wait_resumed()
+        }
+    }
+
+    /**
+     * @brief Apply the state of a client to the engine. REACTOR: set its
+     * epoll events (no EPOLLIN while paused, EPOLLOUT while a backlog is
+     * queued). IO_URING: have the ring thread receive again once resumed
+     * (it cancels the receive of a paused client itself). The mutex of the
+     * connection must be held.
+     */
+    void
+    update_events(Connection &c);
+
+    /**
+     * @brief THREADS engine: wait until the FIFO of a paused client is read
+     * down to its low watermark, or the client is closed.
+     */
+    void
+    wait_resumed(SOCKET client_socket)
+    {
+        std::shared_ptr<Connection> c = get_connection(client_socket);
+        if(!c)
+            return;
+        std::unique_lock<std::mutex> lock(c->mutex);
+        c->cv.wait(lock, [&]() { return !c->paused || !c->open; });
+    }
+
+    /**
+     * @brief Store a received chunk in the client FIFO, within the FIFO
+     * limits, and call the callback.
+     * @param client_socket Socket the data was received on.
+     * @param buffer Received bytes.
+     * @param size Number of received bytes.
+     * @param ts Timestamps of the chunk (see set_timestamping()).
+     * @return false to stop reading the socket: the client was paused or
+     * is being disconnected by the FIFO limits.
+     */
+    bool
+    on_receive(SOCKET client_socket,
+               uint8_t *buffer,
+               size_t size,
+               const RxTimestamp &ts = RxTimestamp())
+    {
+        m_rx_bytes += size;
+#ifdef TCP_QUICKACK
+        if(m_profile.quickack == 1) // cleared by the kernel, set it again
+        {
+            int one = 1;
+            setsockopt(client_socket, IPPROTO_TCP, TCP_QUICKACK, &one,
+                       sizeof(one));
+        }
+#endif
+        std::shared_ptr<Connection> c = get_connection(client_socket);
+        if(!c)
+            return true;
+        size_t fifo_size;
+        bool wake;
+        bool paused;
+        {
+            std::lock_guard<std::mutex> lock(c->mutex);
+            FifoLimits::Admission admission =
+                m_fifo_limits.admit(c->fifo.size(), size);
+            if(admission.disconnect)
+            {
+                c->stats.dropped += size;
+                m_rx_dropped += size;
+                logln("FIFO of socket " + std::to_string(client_socket) +
+                          " full, disconnecting",
+                      true);
+                // the receive side sees the end of the stream and removes it
+                if(c->open)
+                    shutdown(client_socket, SHUT_RDWR);
+                return false;
+            }
+            c->fifo.consume(admission.drop_oldest);
+            size_t stored = c->fifo.push(buffer, admission.store);
+            size_t dropped = size - stored + admission.drop_oldest;
+            c->stats.dropped += dropped;
+            m_rx_dropped += dropped;
+            if(admission.pause && !c->paused)
+            {
+                c->paused = true;
+                c->stats.pauses++;
+                update_events(*c);
+            }
+            on_fifo_change(*c);
+            paused = c->paused;
+            fifo_size = c->fifo.size();
+            if(m_timestamping && stored)
+            {
+                c->rx_total += stored;
+                prune_stamps(*c);
+                c->stamps.push_back({c->rx_total, ts});
+            }
+            wake = !c->wanted.empty() && fifo_size >= *c->wanted.begin();
+        }
+        if(wake)
+            c->cv.notify_all();
+
+        logln("Socket " + std::to_string(client_socket) + " received [" +
+                  std::to_string(size) +
+                  " bytes], size fifo: " + std::to_string(fifo_size),
+              true);
+
+        record_rx_latency(ts);
+        if(c->framer)
+            deliver_frames(client_socket, *c);
+        else if(m_ts_callback)
+            m_ts_callback(this, buffer, size,
+                          reinterpret_cast<void *>(&client_socket), ts,
+                          m_ts_callback_data);
+        else if(m_callback)
+        {
+            m_callback(this, buffer, size,
+                       reinterpret_cast<void *>(&client_socket),
+                       m_callback_data);
+        }
+        return !paused;
+    }
+
+    /**
+     * @brief Give the whole frames held in the FIFO of a client to the frame
+     * callback. Only the receive thread of the client pushes to its FIFO, so
+     * a frame pointing in the FIFO stays valid after the lock is released.
+     */
+    void
+    deliver_frames(SOCKET client_socket, Connection &c)
+    {
+        const uint8_t *frame;
+        size_t size;
+        while(true)
+        {
+            Framer::Status status;
+            {
+                std::lock_guard<std::mutex> lock(c.mutex);
+                status = c.framer->next(c.fifo, frame, size);
+                on_fifo_change(c);
+            }
+            if(status == Framer::INCOMPLETE)
+                break;
+            if(status == Framer::FRAME)
+            {
+                if(m_frame_callback)
+                    m_frame_callback(this, frame, size, client_socket,
+                                     m_frame_callback_data);
+            }
+            else if(status == Framer::BAD_CRC)
+                logln("CRC error", true);
+            else
+                logln("Oversized frame, FIFO of socket " +
+                          std::to_string(client_socket) + " cleared",
+                      true);
+        }
+    }
+
+    /**
+     * @brief Queue a buffer for a client and send what the socket takes now,
+     * an I/O thread sends the rest (see drain()).
+     * @return false if the buffer was dropped.
+     */
+    bool
+    enqueue(const std::shared_ptr<Connection> &c,
+            SharedBuffer buffer,
+            SendQueue::Callback callback = nullptr,
+            void *data = nullptr)
+    {
+        if(c->tx)
+            c->tx->flush(); // keep the order of the messages
+        if(!push(*c, std::move(buffer), callback, data))
+        {
+            c->txq.complete();
+            return false;
+        }
+        drain(c);
+        return true;
+    }
+
+    /**
+     * @brief Add a buffer to the send queue of a client, disconnecting it if
+     * the queue overflows (SendQueue::DISCONNECT).
+     * @return false if the buffer was dropped.
+     */
+    bool
+    push(Connection &c,
+         SharedBuffer buffer,
+         SendQueue::Callback callback = nullptr,
+         void *data = nullptr)
+    {
+        SendQueue::Status status = c.txq.push(std::move(buffer), callback, data);
+        if(status == SendQueue::OVERFLOW)
+        {
+            logln("Send queue of socket " + std::to_string(c.socket) +
+                      " full, disconnecting",
+                  true);
+            std::lock_guard<std::mutex> lock(c.mutex);
+            // the receive side sees the end of the stream and removes it
+            if(c.open)
+                shutdown(c.socket, SHUT_RDWR);
+        }
+        return status == SendQueue::QUEUED;
+    }
+
+    /**
+     * @brief Coalescer::Overflow of the clients: queue the bytes the socket
+     * did not take. Called under the coalescer lock, so the completions are
+     * left to the next drain.
+     */
+    static void
+    coalescer_overflow(void *data, SharedBuffer tail)
+    {
+        Connection *c = static_cast<Connection *>(data);
+        if(c->server->push(*c, std::move(tail)))
+            c->server->drain(c->shared_from_this(), false);
+    }
+
+    /**
+     * @brief Send the queue of a client without blocking and, if bytes are
+     * left, wait for the socket to be writable: EPOLLOUT on the epoll of
+     * the connection (REACTOR engine), the writer thread otherwise. Then
+     * call the completion callbacks.
+     * @param complete False to leave the callbacks to the next call.
+     */
+    void
+    drain(const std::shared_ptr<Connection> &c, bool complete = true);
+
+    /**
+     * @brief Writer thread: wait for the sockets with a send backlog to be
+     * writable and drain them.
+     */
+    void
+    writer_loop();
+
+    void
+    stop_writer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_tx_mutex);
+            m_tx_stop = true;
+            m_tx_cv.notify_all();
+        }
+        if(m_tx_thread.joinable())
+            m_tx_thread.join();
+        std::lock_guard<std::mutex> lock(m_tx_mutex);
+        for(std::shared_ptr<Connection> &c : m_tx_pending) c->tx_pending = false;
+        m_tx_pending.clear();
+        m_tx_stop = false;
+    }
+
+    /**
+     * @brief Look up the state of a client.
+     * @return The client state, nullptr if the client is unknown.
+     */
+    std::shared_ptr<Connection>
+    get_connection(SOCKET s)
+    {
+        return m_connections.find(s);
+    }
+
+    /**
+     * @brief Register a freshly accepted client and call the new client callback.
+     */
+    void
+    add_client(SOCKET client_socket, SOCKADDR_IN &client_addr)
+    {
+        logln("Client connected from " +
+                  std::string(inet_ntoa(client_addr.sin_addr)) + ":" +
+                  std::to_string(ntohs(client_addr.sin_port)),
+              true);
+        m_profile.apply(client_socket);
+        if(m_timestamping && !Timestamping::enable_rx(client_socket))
+            logln("RX timestamping not supported", true);
+        std::shared_ptr<Connection> c = std::make_shared<Connection>();
+        c->socket = client_socket;
+        c->generation = ++m_generation;
+        if(m_framer)
+            c->framer.reset(new Framer(*m_framer));
+        c->server = this;
+        if(m_tx_budget_us >= 0)
+        {
+            c->tx.reset(
+                new Coalescer(client_socket, m_tx_budget_us, m_tx_threshold));
+            c->tx->set_overflow(coalescer_overflow, c.get());
+        }
+        if(m_zc_threshold > 0)
+            c->zc.reset(new ZeroCopy(client_socket, m_zc_threshold));
+        c->txq.set_limit(m_txq_limit, m_txq_policy);
+        m_connections.insert(client_socket, c);
+        if(m_callback_newClient)
+        {
+            m_callback_newClient(this, reinterpret_cast<void *>(&client_addr),
+                                 client_socket, m_callback_data_newClient);
+        }
+    }
+
+    /**
+     * @brief Close the client socket, remove it from the containers and wake
+     * up the readers blocked on it.
+     */
+    void
+    remove_client(SOCKET client_socket)
+    {
+        // the socket number can be reused as soon as it is closed: forget it
+        // first, so that the next client on it is not removed too
+        std::shared_ptr<Connection> c = m_connections.erase(client_socket);
+        if(c)
+        {
+            // stale the handles before the number can be reused
+            std::lock_guard<std::mutex> lock(c->mutex);
+            c->open = false;
+            MemoryBudget::instance().add(-(long)c->accounted);
+            c->accounted = 0;
+        }
+        if(c && c->tx)
+        {
+            c->tx->flush();
+            c->tx->close();
+        }
+        if(c && c->zc)
+            c->zc->close();
+        if(c)
+            c->txq.clear();
         closesocket(client_socket);
-        // Remove the socket from containers
-        m_clients.erase(client_socket);
-        m_fifos.erase(client_socket);
-        m_mutexes.erase(client_socket);
+        if(c)
+        {
+            c->cv.notify_all();
+            c->txq.complete();
+        }
     }
 
     private:
-    std::unordered_map<SOCKET, std::deque<uint8_t>> m_fifos;
-    std::unordered_map<SOCKET, std::thread> m_threads;
-    std::unordered_map<SOCKET, std::mutex> m_mutexes;
+    ConnectionTable<SOCKET, Connection> m_connections;
+    std::atomic<uint64_t> m_generation{0};
+    // THREADS engine: one thread per client, owned by the accept thread
+    struct ClientThread
+    {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+    std::vector<ClientThread> m_threads;
     std::thread m_accept_thread;
     bool m_nagled = false;
     bool m_quickack = false;
+    std::unique_ptr<Framer> m_framer;
+    void (*m_frame_callback)(Server *server,
+                             const uint8_t *frame,
+                             size_t size,
+                             SOCKET client_socket,
+                             void *data) = nullptr;
+    void *m_frame_callback_data = nullptr;
+    int m_tx_budget_us = -1; // -1 when coalescing is disabled
+    size_t m_tx_threshold = 0;
+    size_t m_zc_threshold = 0; // 0 when zero-copy is disabled
+    size_t m_txq_limit = 4 * 1024 * 1024; // see set_send_queue()
+    SendQueue::Policy m_txq_policy = SendQueue::DROP;
+    // writer thread, started by the first backlog
+    std::thread m_tx_thread;
+    std::mutex m_tx_mutex;
+    std::condition_variable m_tx_cv;
+    std::vector<std::shared_ptr<Connection>> m_tx_pending;
+    bool m_tx_stop = false;
+
+    // REACTOR and IO_URING engines (see tcp_client.cpp)
+    std::vector<std::thread> m_io_threads;
+    std::vector<int> m_epoll_fds;
+    int m_wake_fd = -1;
+    int m_n_shards = 0; // see set_shards()
+    bool m_pin_shards = true;
+    std::vector<SOCKET> m_shard_fds;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_shard_accepts;
+    std::unique_ptr<URing> m_uring;
+    // IO_URING engine: resumed clients whose receive the ring thread re-arms
+    std::mutex m_uring_mutex;
+    std::vector<SOCKET> m_uring_resumed;
+    bool
+    start_reactor();
+    bool
+    start_uring();
+    void
+    stop_engine();
+    /**
+     * @brief Open one more SO_REUSEPORT listening socket on the port of m_fd.
+     */
+    SOCKET
+    open_shard();
+    /**
+     * @param listen_fd Listening socket watched by this thread.
+     * @param shard Index of the shard, -1 without shards.
+     */
+    void
+    reactor_loop(int epoll_fd, SOCKET listen_fd, int shard);
+    void
+    uring_loop();
     void
     accept_connections()
     {
@@ -417,23 +1464,29 @@ class TCPServer : public Server
 #endif
                 break;
             }
-            logln("Client connected from " +
-                      std::string(inet_ntoa(client_addr.sin_addr)) + ":" +
-                      std::to_string(ntohs(client_addr.sin_port)),
-                  true);
-
-            m_clients.insert(client_socket);
-            m_fifos[client_socket] = std::deque<uint8_t>();
-
-            m_mutexes[client_socket]; //create a mutex for the client
-            m_threads[client_socket] =
-                std::thread(&TCPServer::handle_client, this, client_socket);
-            if(m_callback_newClient)
+            add_client(client_socket, client_addr);
+            // join the threads of the clients gone since the last accept
+            for(size_t i = 0; i < m_threads.size();)
             {
-                m_callback_newClient(this,
-                                     reinterpret_cast<void *>(&client_addr),
-                                     client_socket, m_callback_data_newClient);
+                if(*m_threads[i].done)
+                {
+                    m_threads[i].thread.join();
+                    m_threads[i] = std::move(m_threads.back());
+                    m_threads.pop_back();
+                }
+                else
+                    i++;
             }
+            std::shared_ptr<std::atomic<bool>> done =
+                std::make_shared<std::atomic<bool>>(false);
+            m_threads.push_back(
+                {std::thread(
+                     [this, client_socket, done]()
+                     {
+                         handle_client(client_socket);
+                         *done = true;
+                     }),
+                 done});
         }
     }
 };
@@ -0,0 +1,179 @@
+#ifndef __TIMESTAMPING_HPP__
+#define __TIMESTAMPING_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "error_queue.hpp"
+
+#if defined(linux) || defined(__APPLE__)
+#include <sys/socket.h>
+#elif defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+
+namespace Communication
+{
+
+/**
+ * @brief Times of a chunk of received bytes, in nanoseconds of CLOCK_REALTIME
+ * (the clock of the kernel software timestamps).
+ */
+struct RxTimestamp
+{
+    int64_t kernel_ns = 0; ///< Software RX timestamp of the kernel, 0 if none.
+    int64_t user_ns = 0;   ///< Time the bytes were read from the socket.
+};
+
+/**
+ * @brief Running count/min/mean/max of latencies, in nanoseconds.
+ */
+struct LatencyStats
+{
+    uint64_t count = 0;
+    int64_t min_ns = 0;
+    int64_t max_ns = 0;
+    int64_t sum_ns = 0;
+
+    void
+    add(int64_t ns);
+
+    double
+    mean_ns() const
+    {
+        return count ? (double)sum_ns / count : 0;
+    }
+
+    /**
+     * @brief "n=.. min=..us mean=..us max=..us", e.g. for logs.
+     */
+    std::string
+    to_string() const;
+};
+
+/**
+ * @brief Kernel timestamping (SO_TIMESTAMPING, Linux). The functions do
+ * nothing, and the timestamps stay 0, on the other platforms.
+ */
+namespace Timestamping
+{
+
+/**
+ * @brief Current time of the timestamp clock.
+ */
+int64_t
+now_ns();
+
+/**
+ * @brief Ask the kernel for software RX timestamps on a socket.
+ * @return false if the kernel refused.
+ */
+bool
+enable_rx(int fd);
+
+/**
+ * @brief Size of the control buffer recvmsg() needs for the timestamp.
+ */
+size_t
+control_size();
+
+/**
+ * @brief Kernel RX timestamp held in the control data of a recvmsg().
+ * @return 0 if there is none.
+ */
+int64_t
+rx_timestamp(const void *control, size_t control_size);
+
+/**
+ * @brief recv() or recvfrom() that also returns the timestamps of the bytes.
+ * @param from, from_size Source address, may be null.
+ */
+long
+recv(int fd,
+     void *buffer,
+     size_t size,
+     int flags,
+     RxTimestamp &ts,
+     struct sockaddr *from = nullptr,
+     socklen_t *from_size = nullptr);
+
+} // namespace Timestamping
+
+/**
+ * @brief TX timestamps of a client socket: the time from a write to its
+ * last byte being handed to the device (software TX timestamp) and to its
+ * ACK by the peer (TCP).
+ *
+ * The kernel reports them on the socket error queue, keyed by byte offset
+ * (stream) or datagram number (SOF_TIMESTAMPING_OPT_ID), so a report covers
+ * every write up to it, coalesced and zero-copy ones included.
+ * Not thread-safe.
+ */
+class TxTimestamps
+{
+    public:
+    /**
+     * @brief Enable the TX timestamps on a new socket and forget the writes
+     * of the previous one.
+     * @param errors Error queue of the socket when it is shared with
+     * ZeroCopy, nullptr to read it alone.
+     * @return false if the kernel refused.
+     */
+    bool
+    attach(int fd, std::shared_ptr<ErrorQueue> errors = nullptr);
+
+    /**
+     * @brief Record a write of size bytes (one datagram on a datagram socket).
+     * @param user_ns Time taken before the send: on the loopback the ACK is
+     * processed within the send syscall.
+     */
+    void
+    on_send(size_t size, int64_t user_ns);
+
+    /**
+     * @brief Read the timestamps waiting on the error queue.
+     */
+    void
+    read();
+
+    const LatencyStats &
+    send_latency() const
+    {
+        return m_send;
+    }
+
+    const LatencyStats &
+    ack_latency() const
+    {
+        return m_ack;
+    }
+
+    protected:
+    /**
+     * @brief Account for a timestamp of kind SCM_TSTAMP_SND or SCM_TSTAMP_ACK
+     * reported for the write ending at id.
+     */
+    void
+    on_timestamp(uint32_t kind, uint32_t id, int64_t ns);
+
+    struct Write
+    {
+        int64_t user_ns;
+        bool sent; // SCM_TSTAMP_SND seen
+    };
+
+    std::shared_ptr<ErrorQueue> m_errors;
+    bool m_stream = true;
+    uint64_t m_units = 0;                // bytes or datagrams written
+    std::map<uint64_t, Write> m_writes;  // by id of their last unit
+    LatencyStats m_send;
+    LatencyStats m_ack;
+};
+
+} // namespace Communication
+
+#endif // __TIMESTAMPING_HPP__
@@ -2,15 +2,18 @@
 #define __UDP_CLIENT_HPP__
 
 #include "com_client.hpp"
-#include <algorithm> // for std::copy
+#include "uring.hpp"
+#include <algorithm>
 #include <cstring>
 #include <deque>
 #include <iostream>
+#include <memory>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
 #if defined(linux) || defined(__APPLE__)
+#include <poll.h>
 typedef struct in_addr IN_ADDR;
 #endif
 
@@ -56,6 +59,12 @@ class UDP : public Client
     int
     writeS(const void *buffer, size_t size, bool add_crc = false);
 
+    /**
+     * @brief writevS send the segments as one datagram (sendmsg).
+     */
+    int
+    writevS(const struct iovec *segments, int n_segments, bool add_crc = false);
+
     private:
     /* data */
     uint32_t m_size_addr;
@@ -91,8 +100,16 @@ class UDPServer : public Server
             return;
         m_is_running = false;
         logln("Waiting for receive thread to join", true);
+        wake_uring();
         if(m_receive_thread.joinable())
             m_receive_thread.join();
+        release_uring();
+        {
+            std::lock_guard<std::mutex> lock(m_fifo_mutex);
+            for(auto &sender : m_fifos)
+                MemoryBudget::instance().add(-(long)sender.second.fifo.size());
+            m_fifos.clear();
+        }
         logln("UDP Server stopped", true);
         Server::stop();
     }
@@ -105,6 +122,22 @@ class UDPServer : public Server
                       sizeof(SOCKADDR));
     }
 
+    /**
+     * @brief Size, high-water mark and drop counters of the FIFO of the
+     * datagrams of a sender (see set_fifo_limits()).
+     */
+    FifoStats
+    fifo_stats(const SOCKADDR_IN &addr)
+    {
+        std::lock_guard<std::mutex> lock(m_fifo_mutex);
+        auto it = m_fifos.find(addr.sin_addr.s_addr);
+        if(it == m_fifos.end())
+            return FifoStats();
+        FifoStats stats = it->second.stats;
+        stats.size = it->second.fifo.size();
+        return stats;
+    }
+
     void
     broadcast(const void *buffer, size_t size) override
     {
@@ -154,6 +187,9 @@ class UDPServer : public Server
         {
             throw log_error("Failed to create UDP socket");
         }
+        m_profile.apply(m_fd);
+        if(m_timestamping && !Timestamping::enable_rx(m_fd))
+            logln("RX timestamping not supported", true);
 
         // Set up the server address
         SOCKADDR_IN server_addr;
@@ -177,7 +213,10 @@ class UDPServer : public Server
 
         // Start receiving data in a separate thread
         // std::thread(&UDPServer::receive_data, this).detach();
-        m_receive_thread = std::thread(&UDPServer::receive_data, this);
+        if(m_engine == IO_URING && start_uring())
+            m_receive_thread = std::thread(&UDPServer::uring_loop, this);
+        else
+            m_receive_thread = std::thread(&UDPServer::receive_data, this);
     }
 
     void
@@ -187,9 +226,105 @@ class UDPServer : public Server
         // No persistent connection in UDP, this is intentionally left blank.
     }
 
+    /**
+     * @brief Store a received datagram in the sender FIFO, within the FIFO
+     * limits, and call the callback (or echo it back if no callback is set).
+     * The socket is shared by the senders and cannot be paused: PAUSE drops
+     * the new datagrams, DISCONNECT forgets the sender. DROP_OLDEST drops
+     * whole datagrams, at least the bytes asked by the limits.
+     */
+    void
+    on_datagram(uint8_t *buffer,
+                size_t size,
+                SOCKADDR_IN &client_addr,
+                const RxTimestamp &ts = RxTimestamp())
+    {
+        m_rx_bytes += size;
+        size_t fifo_size;
+        {
+            std::lock_guard<std::mutex> lock(m_fifo_mutex);
+            SenderFifo &sender = m_fifos[client_addr.sin_addr.s_addr];
+            RingBuffer &fifo = sender.fifo;
+            size_t before = fifo.size();
+            FifoLimits::Admission admission =
+                m_fifo_limits.admit(before, size, false);
+            size_t dropped = size;
+            if(admission.disconnect)
+            {
+                dropped += before;
+                fifo.clear();
+            }
+            else if(admission.store == size) // whole datagrams only
+            {
+                dropped = 0;
+                while(dropped < admission.drop_oldest &&
+                      !sender.datagrams.empty())
+                {
+                    dropped += sender.datagrams.front();
+                    sender.datagrams.pop_front();
+                }
+                fifo.consume(dropped);
+                fifo.push(buffer, size);
+                sender.datagrams.push_back(size);
+            }
+            sender.stats.dropped += dropped;
+            sender.stats.high_water =
+                std::max(sender.stats.high_water, fifo.size());
+            m_rx_dropped += dropped;
+            MemoryBudget::instance().add((long)fifo.size() - (long)before);
+            fifo_size = fifo.size();
+            if(admission.disconnect)
+                m_fifos.erase(client_addr.sin_addr.s_addr);
+        }
+
+        logln("size fifo: " + std::to_string(fifo_size), true);
+        logln("Received [" + std::to_string(size) + " bytes] from " +
+                  std::string(inet_ntoa(client_addr.sin_addr)),
+              true);
+
+        record_rx_latency(ts);
+        if(m_ts_callback != nullptr)
+            m_ts_callback(this, buffer, size,
+                          reinterpret_cast<void *>(&client_addr), ts,
+                          m_ts_callback_data);
+        else if(m_callback != nullptr)
+        {
+            m_callback(this, buffer, size,
+                       reinterpret_cast<void *>(&client_addr),
+                       m_callback_data);
+        }
+        else
+        {
+            // Echo the data back
+            sendto(m_fd, (const char *)buffer, size, 0,
+                   reinterpret_cast<SOCKADDR *>(&client_addr),
+                   sizeof(client_addr));
+        }
+    }
+
     private:
-    std::unordered_map<uint32_t, std::deque<uint8_t>> m_fifos;
+    struct SenderFifo
+    {
+        RingBuffer fifo;
+        std::deque<size_t> datagrams; ///< Sizes of those in fifo, oldest first.
+        FifoStats stats;
+    };
+    std::mutex m_fifo_mutex;
+    std::unordered_map<uint32_t, SenderFifo> m_fifos;
     std::thread m_receive_thread;
+
+    // IO_URING engine (see udp_client.cpp)
+    std::unique_ptr<URing> m_uring;
+    int m_wake_fd = -1;
+    bool
+    start_uring();
+    void
+    wake_uring();
+    void
+    release_uring();
+    void
+    uring_loop();
+
     void
     receive_data()
     {
@@ -208,42 +343,24 @@ class UDPServer : public Server
 
         while(m_is_running)
         {
-            int bytes_received = recvfrom(
-                m_fd, buffer, sizeof(buffer) - 1, 0,
-                reinterpret_cast<SOCKADDR *>(&client_addr), &client_addr_len);
+            RxTimestamp ts;
+            int bytes_received =
+                m_timestamping
+                    ? Timestamping::recv(
+                          m_fd, buffer, sizeof(buffer) - 1, 0, ts,
+                          reinterpret_cast<SOCKADDR *>(&client_addr),
+                          &client_addr_len)
+                    : recvfrom(m_fd, buffer, sizeof(buffer) - 1, 0,
+                               reinterpret_cast<SOCKADDR *>(&client_addr),
+                               &client_addr_len);
+
+            m_rx_syscalls++;
 
             if(bytes_received > 0)
             {
                 buffer[bytes_received] = '\0'; // Null-terminate
-                auto addr_key = client_addr.sin_addr.s_addr;
-                if(m_fifos.find(addr_key) == m_fifos.end())
-                {
-                    m_fifos[addr_key] = std::deque<uint8_t>();
-                }
-                m_fifos[addr_key].insert(m_fifos[addr_key].end(), buffer,
-                                         buffer + bytes_received);
-
-                logln("size deq: " + std::to_string(m_fifos[addr_key].size()),
-                      true);
-                logln("Received [" + std::to_string(bytes_received) +
-                          " bytes] from " +
-                          std::string(inet_ntoa(client_addr.sin_addr)),
-                      true);
-
-                if(m_callback != nullptr)
-                {
-                    m_callback(this, reinterpret_cast<uint8_t *>(buffer),
-                               bytes_received,
-                               reinterpret_cast<void *>(&client_addr),
-                               m_callback_data);
-                }
-                else
-                {
-                    // Echo the data back
-                    sendto(m_fd, buffer, bytes_received, 0,
-                           reinterpret_cast<SOCKADDR *>(&client_addr),
-                           client_addr_len);
-                }
+                on_datagram(reinterpret_cast<uint8_t *>(buffer), bytes_received,
+                            client_addr, ts);
             }
             else if(bytes_received == SOCKET_ERROR)
             {
@@ -259,8 +376,9 @@ class UDPServer : public Server
 #else
                 if(errno == EWOULDBLOCK || errno == EAGAIN)
                 {
-                    // No data available, avoid busy looping
-                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    // No data available, wait for the socket (or stop())
+                    struct pollfd pfd = {m_fd, POLLIN, 0};
+                    poll(&pfd, 1, 100);
                     continue;
                 }
                 std::cerr << "Error receiving data: " << strerror(errno)
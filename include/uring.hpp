@@ -0,0 +1,197 @@
+#ifndef __URING_HPP__
+#define __URING_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#endif
+
+namespace Communication
+{
+
+/**
+ * @brief Minimal io_uring wrapper used by the server engines.
+ *
+ * It talks to the kernel through the raw io_uring syscalls (no liburing
+ * dependency) and only exposes what the servers need: multishot
+ * accept/recv/recvmsg, a plain read, cancellation and a provided-buffer
+ * ring.
+ * A ring is meant to be driven by a single thread.
+ */
+class URing
+{
+    public:
+    URing() = default;
+    ~URing();
+
+    URing(const URing &) = delete;
+    URing &
+    operator=(const URing &) = delete;
+
+    /**
+     * @brief Check at runtime that the kernel provides everything the
+     * engines use (multishot receive, provided-buffer rings).
+     * @return True if io_uring engines can be used on this host.
+     */
+    static bool
+    supported();
+
+    /**
+     * @brief Create the ring.
+     * @param entries Number of submission queue entries.
+     * @return True on success.
+     */
+    bool
+    init(unsigned entries);
+
+    bool
+    is_open() const
+    {
+        return m_fd >= 0;
+    }
+
+#ifdef __linux__
+    /**
+     * @brief Get a zeroed submission entry. When the queue is full, the
+     * pending entries are submitted first to make room.
+     * @return nullptr if the queue is still full.
+     */
+    struct io_uring_sqe *
+    get_sqe();
+
+    /**
+     * @brief Queue a request. The prep functions return false if no
+     * submission entry could be had: the request is lost.
+     */
+    bool
+    prep_multishot_accept(int fd, uint64_t user_data);
+    bool
+    prep_multishot_recv(int fd, uint16_t bgid, uint64_t user_data);
+    bool
+    prep_multishot_recvmsg(int fd,
+                           struct msghdr *msg,
+                           uint16_t bgid,
+                           uint64_t user_data);
+    bool
+    prep_read(int fd, void *buffer, unsigned size, uint64_t user_data);
+    /**
+     * @brief Cancel the request of user_data target (a multishot one ends
+     * with -ECANCELED).
+     */
+    bool
+    prep_cancel(uint64_t target, uint64_t user_data);
+
+    /**
+     * @brief Submit the pending entries and wait for completions.
+     * @param wait_nr Minimum number of completions to wait for.
+     * @return Number of submitted entries, or -errno.
+     */
+    int
+    submit(unsigned wait_nr = 0);
+
+    /**
+     * @brief Call handler(cqe) on every available completion.
+     * @return Number of handled completions.
+     */
+    template <typename F>
+    unsigned
+    drain(F handler)
+    {
+        unsigned head = *m_cq_khead;
+        unsigned n = 0;
+        while(head != __atomic_load_n(m_cq_ktail, __ATOMIC_ACQUIRE))
+        {
+            handler(&m_cqes[head & m_cq_mask]);
+            __atomic_store_n(m_cq_khead, ++head, __ATOMIC_RELEASE);
+            n++;
+        }
+        return n;
+    }
+
+    /**
+     * @brief Register a provided-buffer ring the kernel picks receive
+     * buffers from.
+     * @param bgid Buffer group id used by the receive requests.
+     * @param n_buffers Number of buffers (power of two).
+     * @param buffer_size Size of each buffer.
+     * @return True on success.
+     */
+    bool
+    setup_buffer_ring(uint16_t bgid, uint16_t n_buffers, uint32_t buffer_size);
+
+    /**
+     * @brief Address of the provided buffer bid.
+     */
+    uint8_t *
+    buffer(uint16_t bid)
+    {
+        return m_buffers + (size_t)bid * m_buffer_size;
+    }
+
+    uint32_t
+    buffer_size() const
+    {
+        return m_buffer_size;
+    }
+
+    /**
+     * @brief Give a consumed buffer back to the kernel.
+     */
+    void
+    recycle(uint16_t bid);
+#endif
+
+    /**
+     * @brief Number of io_uring_enter calls made on this ring.
+     */
+    uint64_t
+    enter_calls() const
+    {
+        return m_enter_calls;
+    }
+
+    private:
+    void
+    close_ring();
+
+    int m_fd = -1;
+    uint64_t m_enter_calls = 0;
+
+#ifdef __linux__
+    // submission queue
+    void *m_sq_ptr = nullptr;
+    size_t m_sq_size = 0;
+    unsigned *m_sq_khead = nullptr;
+    unsigned *m_sq_ktail = nullptr;
+    unsigned *m_sq_array = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned m_sq_entries = 0;
+    unsigned m_sq_tail = 0;
+    struct io_uring_sqe *m_sqes = nullptr;
+    size_t m_sqes_size = 0;
+
+    // completion queue
+    void *m_cq_ptr = nullptr;
+    size_t m_cq_size = 0;
+    unsigned *m_cq_khead = nullptr;
+    unsigned *m_cq_ktail = nullptr;
+    unsigned m_cq_mask = 0;
+    struct io_uring_cqe *m_cqes = nullptr;
+
+    // provided buffers
+    struct io_uring_buf_ring *m_buf_ring = nullptr;
+    size_t m_buf_ring_size = 0;
+    uint16_t m_buf_mask = 0;
+    uint16_t m_buf_tail = 0;
+    uint8_t *m_buffers = nullptr;
+    size_t m_buffers_size = 0;
+    uint32_t m_buffer_size = 0;
+#endif
+};
+
+} // namespace Communication
+
+#endif // __URING_HPP__
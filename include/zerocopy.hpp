@@ -0,0 +1,144 @@
+#ifndef __ZEROCOPY_HPP__
+#define __ZEROCOPY_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "error_queue.hpp"
+
+namespace Communication
+{
+
+/**
+ * @brief Zero-copy sends (SO_ZEROCOPY/MSG_ZEROCOPY) on a stream socket.
+ *
+ * Buffers of at least the threshold are sent with MSG_ZEROCOPY: the kernel
+ * transmits them from the caller's pages, so the buffer must not be modified
+ * or freed until the send is reported complete through the socket error
+ * queue. Smaller buffers, and every buffer on platforms or kernels without
+ * SO_ZEROCOPY, are sent with a plain copy and are complete at once.
+ * The class is thread-safe.
+ */
+class ZeroCopy
+{
+    public:
+    /**
+     * @param fd Connected stream socket.
+     * @param threshold Smallest buffer sent without a copy. Below ~10 KB the
+     * page pinning and the notification cost more than the copy.
+     * @param errors Error queue of the socket when it is shared with
+     * TxTimestamps, nullptr to read it alone.
+     */
+    ZeroCopy(int fd,
+             size_t threshold = 16 * 1024,
+             std::shared_ptr<ErrorQueue> errors = nullptr);
+
+    /**
+     * @brief True if the kernel accepted SO_ZEROCOPY on the socket.
+     */
+    bool
+    enabled() const
+    {
+        return m_enabled;
+    }
+
+    void
+    set_threshold(size_t threshold)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_threshold = threshold;
+    }
+
+    /**
+     * @brief Send a buffer, looping on partial writes. Never waits on a
+     * non-blocking socket.
+     * @param id Set to the id to give to done()/wait() before reusing the
+     * buffer. Copied sends get id 0, which is always done.
+     * @return Number of bytes sent, less than size if a non-blocking socket
+     * is full, -1 if the socket is closed or a send failed.
+     */
+    int
+    send(const void *buffer, size_t size, uint64_t *id = nullptr);
+
+    /**
+     * @brief Read the pending completion notifications without blocking.
+     * @return Number of zero-copy sends completed so far.
+     */
+    uint64_t
+    poll();
+
+    /**
+     * @brief True once the send id and every zero-copy send before it are
+     * complete (notifications are read first).
+     */
+    bool
+    done(uint64_t id);
+
+    /**
+     * @brief Wait for done(id).
+     * @param timeout_ms -1 to wait until the send completes.
+     * @return done(id).
+     */
+    bool
+    wait(uint64_t id, int timeout_ms = -1);
+
+    /**
+     * @brief Stop using the socket, to be called before it is closed. The
+     * pending sends are then reported as done: the kernel keeps the pages it
+     * still transmits alive by itself.
+     */
+    void
+    close();
+
+    /**
+     * @brief Number of sends made with MSG_ZEROCOPY.
+     */
+    uint64_t
+    sends() const
+    {
+        return m_sent;
+    }
+
+    /**
+     * @brief Number of zero-copy sends the kernel copied anyway (e.g. on the
+     * loopback, or without scatter-gather support on the device).
+     */
+    uint64_t
+    copied() const
+    {
+        return m_copied;
+    }
+
+    protected:
+    /**
+     * @brief Mark the kernel ids [lo, hi] complete. m_mutex must be held.
+     */
+    void
+    complete(uint32_t lo, uint32_t hi);
+
+    /**
+     * @brief Read the error queue. m_mutex must be held.
+     */
+    void
+    read_notifications();
+
+    std::mutex m_mutex;
+    int m_fd;
+    size_t m_threshold;
+    std::shared_ptr<ErrorQueue> m_errors;
+    bool m_enabled = false;
+    // kernel ids are the index of the MSG_ZEROCOPY sendmsg() on the socket,
+    // extended here to 64 bits; an id is the kernel id of a send + 1
+    std::atomic<uint64_t> m_sent{0};
+    uint64_t m_completed = 0;                // every id up to it is complete
+    std::map<uint64_t, uint64_t> m_early;    // ranges completed out of order
+    std::atomic<uint64_t> m_copied{0};
+};
+
+} // namespace Communication
+
+#endif // __ZEROCOPY_HPP__
@@ -0,0 +1,269 @@
+#include "coalescer.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <errno.h>
+#include <set>
+#include <thread>
+#include <utility>
+
+#if defined(linux) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#elif defined(_WIN32)
+#include <winsock2.h>
+#endif
+
+#ifdef MSG_NOSIGNAL
+// the timer thread must not be killed by a peer closing the connection
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+#ifndef MSG_DONTWAIT
+#define MSG_DONTWAIT 0
+#endif
+
+// delay before the timer tries again to send to a full socket
+#define RETRY_DELAY std::chrono::milliseconds(1)
+
+namespace Communication
+{
+
+/**
+ * @brief Thread flushing the coalescers whose latency budget expired.
+ */
+class FlushTimer
+{
+    public:
+    static FlushTimer &
+    instance()
+    {
+        static FlushTimer s_timer;
+        return s_timer;
+    }
+
+    void
+    arm(Coalescer *c, Coalescer::Clock::time_point deadline)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_due.insert({deadline, c}).first;
+        if(it == m_due.begin())
+            m_cv.notify_all();
+    }
+
+    /**
+     * @brief Forget the deadlines of a coalescer, waiting for the flush in
+     * progress on it if any.
+     */
+    void
+    cancel(Coalescer *c)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for(auto it = m_due.begin(); it != m_due.end();)
+            it = it->second == c ? m_due.erase(it) : std::next(it);
+        m_cv.notify_all();
+        m_cv.wait(lock, [&]() { return m_current != c; });
+    }
+
+    private:
+    FlushTimer() : m_thread(&FlushTimer::run, this) {}
+
+    ~FlushTimer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+    }
+
+    void
+    run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while(!m_stop)
+        {
+            if(m_due.empty())
+            {
+                m_cv.wait(lock);
+                continue;
+            }
+            auto first = *m_due.begin();
+            if(first.first > Coalescer::Clock::now())
+            {
+                m_cv.wait_until(lock, first.first);
+                continue;
+            }
+            m_due.erase(m_due.begin());
+            m_current = first.second;
+            lock.unlock();
+            m_current->on_deadline();
+            lock.lock();
+            m_current = nullptr;
+            m_cv.notify_all();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::set<std::pair<Coalescer::Clock::time_point, Coalescer *>> m_due;
+    Coalescer *m_current = nullptr; // coalescer being flushed
+    bool m_stop = false;
+    std::thread m_thread;
+};
+
+Coalescer::Coalescer(int fd, int budget_us, size_t threshold)
+    : m_fd(fd), m_budget(budget_us < 0 ? 0 : budget_us),
+      m_threshold(threshold)
+{
+}
+
+Coalescer::~Coalescer()
+{
+    FlushTimer::instance().cancel(this);
+}
+
+int
+Coalescer::write(const void *buffer, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_fd < 0)
+        return -1;
+    if(m_budget.count() == 0 || m_buffer.size() + size >= m_threshold)
+        return send_buffer(buffer, size) < 0 ? -1 : (int)size;
+
+    const uint8_t *bytes = (const uint8_t *)buffer;
+    m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+    if(!m_armed)
+    {
+        // a deadline armed earlier only flushes sooner, keep it
+        m_armed = true;
+        FlushTimer::instance().arm(this, Clock::now() + m_budget);
+    }
+    return (int)size;
+}
+
+int
+Coalescer::flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_fd < 0)
+        return -1;
+    return m_buffer.empty() ? 0 : send_buffer(nullptr, 0);
+}
+
+void
+Coalescer::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fd = -1;
+    m_buffer.clear();
+}
+
+void
+Coalescer::on_deadline()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_armed = false;
+    if(m_fd >= 0 && !m_buffer.empty())
+        send_buffer(nullptr, 0, false);
+}
+
+int
+Coalescer::send_buffer(const void *extra, size_t extra_size, bool wait)
+{
+    size_t total = m_buffer.size() + extra_size;
+    size_t sent = 0;
+    bool full = false; // the socket buffer is full
+#if defined(linux) || defined(__APPLE__)
+    int flags = SEND_FLAGS | (wait && !m_overflow ? 0 : MSG_DONTWAIT);
+    struct iovec iov[2] = {{m_buffer.data(), m_buffer.size()},
+                           {(void *)extra, extra_size}};
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    while(sent < total)
+    {
+        ssize_t n = sendmsg(m_fd, &msg, flags);
+        m_sends++;
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            full = errno == EAGAIN || errno == EWOULDBLOCK;
+            break;
+        }
+        sent += n;
+        // skip what was sent on a partial write
+        while(msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len)
+        {
+            n -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if(msg.msg_iovlen > 0)
+        {
+            msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= n;
+        }
+    }
+#else
+    if(extra_size)
+    {
+        const uint8_t *bytes = (const uint8_t *)extra;
+        m_buffer.insert(m_buffer.end(), bytes, bytes + extra_size);
+        extra_size = 0;
+    }
+    while(sent < total)
+    {
+        int n = send(m_fd, (const char *)m_buffer.data() + sent, total - sent,
+                     0);
+        m_sends++;
+        if(n <= 0)
+        {
+            full = n < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+            break;
+        }
+        sent += n;
+    }
+#endif
+    if(!full)
+    {
+        m_buffer.clear();
+        return sent == total ? (int)sent : -1;
+    }
+
+    // keep the bytes not sent, a gap would corrupt the stream
+    std::vector<uint8_t> tail;
+    tail.reserve(total - sent);
+    if(sent < m_buffer.size())
+        tail.insert(tail.end(), m_buffer.begin() + sent, m_buffer.end());
+    size_t extra_sent = sent > m_buffer.size() ? sent - m_buffer.size() : 0;
+    const uint8_t *bytes = (const uint8_t *)extra;
+    tail.insert(tail.end(), bytes + extra_sent, bytes + extra_size);
+    if(m_overflow)
+    {
+        m_buffer.clear();
+        m_overflow(m_overflow_data,
+                   std::make_shared<const std::vector<uint8_t>>(
+                       std::move(tail)));
+    }
+    else
+    {
+        m_buffer.swap(tail);
+        if(!m_armed)
+        {
+            m_armed = true;
+            FlushTimer::instance().arm(
+                this, Clock::now() + std::max<Clock::duration>(m_budget,
+                                                               RETRY_DELAY));
+        }
+    }
+    return (int)sent;
+}
+
+} // namespace Communication
@@ -12,7 +12,8 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 
-#elif __linux__
+#elif defined(__linux__) || defined(__APPLE__)
+#include <netinet/tcp.h>
 #include <sys/ioctl.h>
 #endif
 
@@ -24,8 +25,6 @@ using namespace ESC;
 Client::Client(int verbose) : ESC::CLI(verbose, "Client")
 {
     logln("Init communication client.", true);
-    this->mk_crctable(); //init crc table
-    m_mutex = new std::mutex();
 #ifdef WIN32
     WSADATA wsa;
     int err = WSAStartup(MAKEWORD(2, 2), &wsa);
@@ -42,7 +41,6 @@ Client::~Client(void)
 #ifdef WIN32
     WSACleanup();
 #endif
-    delete m_mutex;
 }
 
 void
@@ -55,27 +53,388 @@ int
 Client::close_connection()
 {
     logln("Closing connection ", true);
-    int n = closesocket(m_fd);
+    int n;
+    {
+        // a writer thread may be in writeS() or write_zerocopy()
+        std::lock_guard<std::mutex> lck(m_tx_mutex);
+        if(m_tx)
+        {
+            m_tx->flush();
+            m_tx.reset();
+        }
+        if(m_zc)
+        {
+            m_zc->close();
+            m_zc.reset();
+        }
+        m_errors.reset();
+        n = closesocket(m_fd);
+        m_fd = INVALID_SOCKET;
+        m_is_connected = false;
+    }
+    {
+        // the bytes buffered from this connection must not be read from the
+        // next one
+        std::lock_guard<std::mutex> lck(m_rx_mutex);
+        if(m_rx_buffer)
+            m_rx_buffer->clear();
+    }
     logln(fstr("OK", {BOLD, FG_GREEN}));
-    m_is_connected = false;
     return n;
 }
 
+SocketProfile
+Client::set_profile(const SocketProfile &profile)
+{
+    std::lock(m_rx_mutex, m_tx_mutex);
+    std::lock_guard<std::mutex> rx_lck(m_rx_mutex, std::adopt_lock);
+    std::lock_guard<std::mutex> tx_lck(m_tx_mutex, std::adopt_lock);
+    m_profile = profile;
+    if(m_fd == INVALID_SOCKET)
+        return SocketProfile();
+    m_profile.apply(m_fd);
+    SocketProfile applied = SocketProfile::query(m_fd);
+    logln("Socket profile: " + applied.to_string(), true);
+    return applied;
+}
+
+void
+Client::rearm_quickack()
+{
+#ifdef TCP_QUICKACK
+    int one = 1;
+    if(m_profile.quickack == 1)
+        setsockopt(m_fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+#endif
+}
+
+void
+Client::set_coalescing(bool enable, int budget_us, size_t threshold)
+{
+    std::lock_guard<std::mutex> lck(m_tx_mutex); //ensure only one thread using it
+    if(m_tx)
+    {
+        m_tx->flush();
+        m_tx.reset();
+    }
+    m_tx_budget_us = enable ? std::max(budget_us, 0) : -1;
+    m_tx_threshold = threshold;
+}
+
+int
+Client::flush()
+{
+    std::lock_guard<std::mutex> lck(m_tx_mutex); //ensure only one thread using it
+    return m_tx ? m_tx->flush() : 0;
+}
+
+int
+Client::write_zerocopy(const void *buffer,
+                       size_t size,
+                       uint64_t *id,
+                       bool add_crc)
+{
+    if(id)
+        *id = 0;
+    return writeS(buffer, size, add_crc);
+}
+
+bool
+Client::zerocopy_done(uint64_t id, int timeout_ms)
+{
+    std::shared_ptr<ZeroCopy> zc;
+    {
+        std::lock_guard<std::mutex> lck(m_tx_mutex);
+        zc = m_zc;
+    }
+    return !zc || zc->wait(id, timeout_ms);
+}
+
+void
+Client::set_zerocopy_threshold(size_t threshold)
+{
+    std::lock_guard<std::mutex> lck(m_tx_mutex); //ensure only one thread using it
+    m_zc_threshold = threshold;
+    if(m_zc)
+        m_zc->set_threshold(threshold);
+}
+
+void
+Client::set_tx_timestamping(bool enable)
+{
+    std::lock_guard<std::mutex> lck(m_tx_mutex); //ensure only one thread using it
+    m_tx_stamps.reset(enable ? new TxTimestamps() : nullptr);
+    if(m_tx_stamps && m_is_connected &&
+       !m_tx_stamps->attach(m_fd, error_queue()))
+        logln("TX timestamping not supported", true);
+}
+
+LatencyStats
+Client::send_latency()
+{
+    std::lock_guard<std::mutex> lck(m_tx_mutex); //ensure only one thread using it
+    if(!m_tx_stamps)
+        return LatencyStats();
+    m_tx_stamps->read();
+    return m_tx_stamps->send_latency();
+}
+
+LatencyStats
+Client::ack_latency()
+{
+    std::lock_guard<std::mutex> lck(m_tx_mutex); //ensure only one thread using it
+    if(!m_tx_stamps)
+        return LatencyStats();
+    m_tx_stamps->read();
+    return m_tx_stamps->ack_latency();
+}
+
 bool
 Client::check_CRC(uint8_t *buffer, int size)
 {
-    if(this->CRC(buffer, size - 2) != *(uint16_t *)(buffer + size - 2))
+    CRCAccumulator crc(m_crc);
+    return finish_CRC(crc, buffer, size);
+}
+
+void
+Client::CRC_segments(const struct iovec *segments,
+                     int n_segments,
+                     bool add_crc,
+                     uint8_t trailer[2],
+                     std::vector<struct iovec> &iov)
+{
+    iov.assign(segments, segments + n_segments);
+    if(!add_crc)
+        return;
+    CRCAccumulator crc(m_crc);
+    for(int i = 0; i < n_segments; i++)
+        crc.update(segments[i].iov_base, segments[i].iov_len);
+    crc.store(trailer);
+    iov.push_back({trailer, 2});
+}
+
+int
+Client::writevS(const struct iovec *segments, int n_segments, bool add_crc)
+{
+    uint8_t trailer[2];
+    std::vector<struct iovec> iov;
+    CRC_segments(segments, n_segments, add_crc, trailer, iov);
+#if defined(linux) || defined(__APPLE__)
+    std::lock_guard<std::mutex> lck(m_tx_mutex); //ensure only one thread using it
+    if(!m_is_connected)
+        return -1;
+    if(m_tx)
+        m_tx->flush(); // keep the order of the messages
+
+    int64_t start_ns = m_tx_stamps ? Timestamping::now_ns() : 0;
+    // loop on partial writes, moving the start of the list forward
+    size_t total = 0;
+    for(auto &segment : iov) total += segment.iov_len;
+    size_t sent = 0;
+    struct iovec *it = iov.data();
+    int count = iov.size();
+    while(sent < total)
     {
-        logln("CRC error", true);
-        return false; //crc error
+        ssize_t n = writev(m_fd, it, count);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return sent ? sent : -1;
+        }
+        sent += n;
+        while(count > 0 && (size_t)n >= it->iov_len)
+        {
+            n -= it->iov_len;
+            it++;
+            count--;
+        }
+        if(count > 0)
+        {
+            it->iov_base = (uint8_t *)it->iov_base + n;
+            it->iov_len -= n;
+        }
+    }
+    if(m_tx_stamps)
+        m_tx_stamps->on_send(sent, start_ns);
+    return sent;
+#else
+    // no vectored write: gather the segments and use writeS()
+    std::vector<uint8_t> staging;
+    for(auto &segment : iov)
+        staging.insert(staging.end(), (uint8_t *)segment.iov_base,
+                       (uint8_t *)segment.iov_base + segment.iov_len);
+    return writeS(staging.data(), staging.size());
+#endif
+}
+
+void
+Client::set_buffered(bool enable, size_t capacity)
+{
+    std::lock_guard<std::mutex> lck(m_rx_mutex); //ensure only one thread using it
+#if defined(linux) || defined(__APPLE__)
+    if(enable)
+        m_rx_buffer.reset(new RingBuffer(capacity, 0)); //fixed size
+    else
+        m_rx_buffer.reset();
+#else
+    (void)capacity;
+    if(enable)
+        logln("Buffered reads are not supported on this platform", true);
+#endif
+}
+
+long
+Client::fill_buffer()
+{
+#if defined(linux) || defined(__APPLE__)
+    size_t len;
+    uint8_t *dst = m_rx_buffer->write_ptr(len);
+    ssize_t n;
+    do {
+        n = read(m_fd, dst, len);
+        m_rx_syscalls++;
+    } while(n < 0 && errno == EINTR);
+    rearm_quickack();
+    if(n > 0)
+        m_rx_buffer->commit(n);
+    return n;
+#else
+    return -1;
+#endif
+}
+
+int
+Client::read_buffered(uint8_t *buffer, size_t size, bool has_crc, bool read_until)
+{
+#if defined(linux) || defined(__APPLE__)
+    RingBuffer &rx = *m_rx_buffer;
+    CRCAccumulator crc(m_crc);
+    size_t body = size < 2 ? 0 : size - 2;
+    size_t done = 0;
+    long n = 0;
+    while(done < size)
+    {
+        if(rx.empty())
+        {
+            if(done > 0 && !read_until)
+                break;
+            if(size - done >= rx.capacity())
+            {
+                // too large for the ring: read straight into the buffer
+                n = read(m_fd, buffer + done, size - done);
+                m_rx_syscalls++;
+                if(n < 0 && errno == EINTR)
+                    continue;
+                rearm_quickack();
+                if(n <= 0)
+                    break;
+                done += n;
+                if(has_crc)
+                    update_CRC(crc, buffer, size, done);
+                continue;
+            }
+            if((n = fill_buffer()) <= 0)
+                break;
+        }
+
+        // the CRC is computed while the bytes leave the ring
+        size_t len;
+        const uint8_t *src = rx.read_ptr(len);
+        len = std::min(len, size - done);
+        size_t hashed = has_crc && done < body ? std::min(len, body - done) : 0;
+        crc.update_copy(buffer + done, src, hashed);
+        memcpy(buffer + done + hashed, src + hashed, len - hashed);
+        rx.consume(len);
+        done += len;
+    }
+    if(done == 0)
+        return n;
+    if(has_crc)
+        return finish_CRC(crc, buffer, size) ? done : -1;
+    return done;
+#else
+    (void)buffer;
+    (void)size;
+    (void)has_crc;
+    (void)read_until;
+    return -1;
+#endif
+}
+
+int
+Client::peekS(uint8_t *buffer, size_t size, bool wait)
+{
+    std::lock_guard<std::mutex> lck(m_rx_mutex); //ensure only one thread using it
+    if(!m_rx_buffer)
+        return -1;
+    size = std::min(size, m_rx_buffer->capacity());
+    while(wait && m_rx_buffer->size() < size)
+        if(fill_buffer() <= 0)
+            break;
+    return m_rx_buffer->peek(buffer, size);
+}
+
+int
+Client::read_frame(Framer &framer, const uint8_t *&frame, size_t &size)
+{
+    std::lock_guard<std::mutex> lck(m_rx_mutex); //ensure only one thread using it
+#if defined(linux) || defined(__APPLE__)
+    size_t needed = std::max<size_t>(framer.max_wire_size(), 64 * 1024);
+    if(!m_rx_buffer)
+        m_rx_buffer.reset(new RingBuffer(needed, 0));
+    else if(m_rx_buffer->capacity() < needed)
+    {
+        m_rx_buffer->set_max_capacity(needed);
+        m_rx_buffer->reserve(needed - m_rx_buffer->size());
+    }
+
+    while(true)
+    {
+        switch(framer.next(*m_rx_buffer, frame, size))
+        {
+        case Framer::FRAME:
+            return 1;
+        case Framer::INCOMPLETE:
+            break;
+        case Framer::BAD_CRC:
+            logln("CRC error", true);
+            return -1;
+        case Framer::OVERSIZED:
+            logln("Oversized frame, buffered data dropped", true);
+            return -1;
+        }
+        if(fill_buffer() <= 0)
+            return 0;
     }
-    return true;
+#else
+    (void)framer;
+    (void)frame;
+    (void)size;
+    logln("Buffered reads are not supported on this platform", true);
+    return -1;
+#endif
+}
+
+size_t
+Client::readable()
+{
+    std::lock_guard<std::mutex> lck(m_rx_mutex); //ensure only one thread using it
+    size_t n = m_rx_buffer ? m_rx_buffer->size() : 0;
+#if defined(linux) || defined(__APPLE__)
+    int pending = 0;
+    if(ioctl(m_fd, FIONREAD, &pending) == 0 && pending > 0)
+        n += pending;
+#endif
+    return n;
 }
 
 bool
 Client::SetSocketBlockingEnabled(bool blocking)
 {
-    std::lock_guard<std::mutex> lck(*m_mutex); //ensure only one thread using it
+    std::lock(m_rx_mutex, m_tx_mutex);
+    std::lock_guard<std::mutex> rx_lck(m_rx_mutex, std::adopt_lock);
+    std::lock_guard<std::mutex> tx_lck(m_tx_mutex, std::adopt_lock);
     if(m_fd < 0)
         return false;
 
@@ -94,39 +453,11 @@ Client::SetSocketBlockingEnabled(bool blocking)
 uint16_t
 Client::CRC(uint8_t *buf, int n)
 {
-    uint16_t m_crc_accumulator = 0;
-    for(int i = 0; i < n; i++)
-        m_crc_accumulator = (m_crc_accumulator << 8) ^
-                            s_crctable[(m_crc_accumulator >> 8) ^ buf[i]];
-    return (m_crc_accumulator >> 8) | (m_crc_accumulator << 8);
-}
-
-uint16_t Client::s_crctable[256];
-void
-Client::mk_crctable(uint16_t genpoly)
-{
-    static bool once = [this, genpoly]() //init crc table only once
-    {
-        for(uint16_t data = 0; data < 256; data++)
-        {
-            uint16_t d = data << 8;
-            uint16_t accum = 0;
-            for(int i = 8; i > 0; i--)
-            {
-                if((d ^ accum) & 0x8000)
-                    accum = (accum << 1) ^ genpoly;
-                else
-                    accum <<= 1;
-                d <<= 1;
-            }
-            s_crctable[data] = accum;
-        }
-        return true;
-    }();
-    if(once)
-        logln("CRC table created", true);
-    else
-        logln("CRC table already created", true);
+    uint8_t trailer[2];
+    m_crc.store(m_crc.compute(buf, n < 0 ? 0 : n), trailer);
+    uint16_t crc;
+    memcpy(&crc, trailer, 2);
+    return crc;
 }
 
 } // namespace Communication
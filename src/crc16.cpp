@@ -0,0 +1,444 @@
+#include "crc16.hpp"
+
+#include <cstring>
+
+#if(defined(__x86_64__) || defined(_M_X64)) && defined(__GNUC__)
+#define CRC16_HAS_PCLMUL 1
+#include <immintrin.h>
+#endif
+
+namespace Communication
+{
+namespace CRC16
+{
+
+typedef CRCTable<0x1021, false, 16> Tables;
+
+static const Tables &
+tables()
+{
+    static constexpr Tables s_tables{};
+    return s_tables;
+}
+
+/**
+ * @brief Kernels are written once for both entry points: with Copy set, the
+ * bytes are also written to dst as they are consumed.
+ */
+template <bool Copy>
+static uint16_t
+update_table(uint16_t crc, uint8_t *dst, const uint8_t *buf, size_t n)
+{
+    const uint16_t *t = tables().t[0];
+    for(size_t i = 0; i < n; i++)
+    {
+        if(Copy)
+            dst[i] = buf[i];
+        crc = (crc << 8) ^ t[(crc >> 8) ^ buf[i]];
+    }
+    return crc;
+}
+
+/**
+ * @brief Slicing-by-N: the register is XORed into the first two bytes of the
+ * block, then every byte goes through the table matching its distance to the
+ * end of the block.
+ */
+template <int N>
+static inline uint16_t
+slicing_step(uint16_t crc, const uint8_t *b)
+{
+    const Tables &tab = tables();
+    uint16_t acc =
+        tab.t[N - 1][b[0] ^ (crc >> 8)] ^ tab.t[N - 2][b[1] ^ (crc & 0xff)];
+    for(int i = 2; i < N; i++) acc ^= tab.t[N - 1 - i][b[i]];
+    return acc;
+}
+
+template <int N, bool Copy>
+static uint16_t
+update_slicing(uint16_t crc, uint8_t *dst, const uint8_t *buf, size_t n)
+{
+    for(; n >= N; n -= N, buf += N, dst += Copy ? N : 0)
+    {
+        uint8_t b[N];
+        memcpy(b, buf, N);
+        if(Copy)
+            memcpy(dst, b, N);
+        crc = slicing_step<N>(crc, b);
+    }
+    return update_table<Copy>(crc, dst, buf, n);
+}
+
+static void
+update_table_x4(uint16_t crc[4], const uint8_t *const buf[4], size_t n)
+{
+    const uint16_t *t = tables().t[0];
+    for(size_t i = 0; i < n; i++)
+        for(int l = 0; l < 4; l++)
+            crc[l] = (crc[l] << 8) ^ t[(crc[l] >> 8) ^ buf[l][i]];
+}
+
+template <int N>
+static void
+update_slicing_x4(uint16_t crc[4], const uint8_t *const buf[4], size_t n)
+{
+    uint16_t c[4] = {crc[0], crc[1], crc[2], crc[3]};
+    size_t i = 0;
+    for(; i + N <= n; i += N)
+        for(int l = 0; l < 4; l++) c[l] = slicing_step<N>(c[l], buf[l] + i);
+    for(int l = 0; l < 4; l++)
+        crc[l] = update_table<false>(c[l], nullptr, buf[l] + i, n - i);
+}
+
+#ifdef CRC16_HAS_PCLMUL
+/**
+ * @brief x^e mod P, the folding constants.
+ */
+static uint64_t
+xpow_mod(int e)
+{
+    uint32_t r = 1;
+    for(int i = 0; i < e; i++)
+    {
+        r <<= 1;
+        if(r & 0x10000)
+            r ^= 0x11021; // x^16 + x^12 + x^5 + 1
+    }
+    return r;
+}
+
+/**
+ * @brief Load 16 bytes (and copy them to dst), byte swapped so that bit i
+ * is the coefficient of x^i (the polynomial is MSB first).
+ */
+template <bool Copy>
+__attribute__((target("pclmul,ssse3"))) static inline __m128i
+load_be(uint8_t *dst, const uint8_t *p)
+{
+    const __m128i swap =
+        _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    if(Copy)
+        _mm_storeu_si128((__m128i *)dst, v);
+    return _mm_shuffle_epi8(v, swap);
+}
+
+/**
+ * @brief x * x^D + next, reduced to 128 bits: k holds x^(D+64) mod P in its
+ * high half and x^D mod P in its low half.
+ */
+__attribute__((target("pclmul,ssse3"))) static inline __m128i
+fold(__m128i x, __m128i k, __m128i next)
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11),
+                                       _mm_clmulepi64_si128(x, k, 0x00)),
+                         next);
+}
+
+/**
+ * @brief Fold 4 lanes of 16 bytes while at least 64 bytes are left, merge
+ * the lanes, then compute the CRC of the 16 remaining bytes of the folded
+ * polynomial (congruent to the data modulo P) and of the tail with tables.
+ */
+template <bool Copy>
+__attribute__((target("pclmul,ssse3"))) static uint16_t
+update_pclmul(uint16_t crc, uint8_t *dst, const uint8_t *buf, size_t n)
+{
+    if(n < 128)
+        return update_slicing<16, Copy>(crc, dst, buf, n);
+
+    static const uint64_t k512_hi = xpow_mod(512 + 64), k512_lo = xpow_mod(512),
+                          k128_hi = xpow_mod(128 + 64), k128_lo = xpow_mod(128);
+    const __m128i k512 = _mm_set_epi64x(k512_hi, k512_lo);
+    const __m128i k128 = _mm_set_epi64x(k128_hi, k128_lo);
+    const size_t step = Copy ? 64 : 0;
+
+    // the initial register is XORed into the 16 first message bits
+    __m128i x0 = _mm_xor_si128(load_be<Copy>(dst, buf),
+                               _mm_set_epi64x((uint64_t)crc << 48, 0));
+    __m128i x1 = load_be<Copy>(dst + 16, buf + 16);
+    __m128i x2 = load_be<Copy>(dst + 32, buf + 32);
+    __m128i x3 = load_be<Copy>(dst + 48, buf + 48);
+    buf += 64;
+    dst += step;
+    n -= 64;
+    for(; n >= 64; n -= 64, buf += 64, dst += step)
+    {
+        x0 = fold(x0, k512, load_be<Copy>(dst, buf));
+        x1 = fold(x1, k512, load_be<Copy>(dst + 16, buf + 16));
+        x2 = fold(x2, k512, load_be<Copy>(dst + 32, buf + 32));
+        x3 = fold(x3, k512, load_be<Copy>(dst + 48, buf + 48));
+    }
+    x1 = fold(x0, k128, x1);
+    x2 = fold(x1, k128, x2);
+    x3 = fold(x2, k128, x3);
+    for(; n >= 16; n -= 16, buf += 16, dst += step / 4)
+        x3 = fold(x3, k128, load_be<Copy>(dst, buf));
+
+    const __m128i swap =
+        _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    uint8_t rest[16];
+    _mm_storeu_si128((__m128i *)rest, _mm_shuffle_epi8(x3, swap));
+    crc = update_slicing<16, false>(0, nullptr, rest, 16);
+    return update_slicing<16, Copy>(crc, dst, buf, n);
+}
+
+/**
+ * @brief One 16 bytes folding lane per stream: the 4 chains of carry-less
+ * multiplications are independent and overlap in the pipeline.
+ */
+__attribute__((target("pclmul,ssse3"))) static void
+update_pclmul_x4(uint16_t crc[4], const uint8_t *const buf[4], size_t n)
+{
+    if(n < 32)
+        return update_slicing_x4<8>(crc, buf, n);
+
+    static const uint64_t k128_hi = xpow_mod(128 + 64), k128_lo = xpow_mod(128);
+    const __m128i k128 = _mm_set_epi64x(k128_hi, k128_lo);
+    const __m128i swap =
+        _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    // frames are short: rather than finishing with a byte loop, the first
+    // block is the n % 16 leading bytes padded with zeros in front (leading
+    // zeros do not change a CRC), with the register XORed into them
+    size_t i = 0, r = n % 16;
+    if(r == 1)
+    {
+        for(int l = 0; l < 4; l++)
+            crc[l] = update_table<false>(crc[l], nullptr, buf[l], 1);
+        i = 1;
+        r = 0;
+    }
+    __m128i x[4];
+    for(int l = 0; l < 4; l++)
+    {
+        if(r == 0)
+            x[l] = _mm_xor_si128(load_be<false>(nullptr, buf[l] + i),
+                                 _mm_set_epi64x((uint64_t)crc[l] << 48, 0));
+        else
+        {
+            uint8_t first[16] = {0};
+            memcpy(first + 16 - r, buf[l], r);
+            first[16 - r] ^= crc[l] >> 8;
+            first[17 - r] ^= crc[l] & 0xff;
+            x[l] = load_be<false>(nullptr, first);
+        }
+    }
+    for(i += r ? r : 16; i < n; i += 16)
+        for(int l = 0; l < 4; l++)
+            x[l] = fold(x[l], k128, load_be<false>(nullptr, buf[l] + i));
+
+    for(int l = 0; l < 4; l++)
+    {
+        uint8_t rest[16];
+        _mm_storeu_si128((__m128i *)rest, _mm_shuffle_epi8(x[l], swap));
+        crc[l] = slicing_step<16>(0, rest);
+    }
+}
+#endif
+
+bool
+supported(Kernel kernel)
+{
+    switch(kernel)
+    {
+    case TABLE:
+    case SLICING_8:
+    case SLICING_16:
+        return true;
+    case PCLMUL:
+#ifdef CRC16_HAS_PCLMUL
+        return __builtin_cpu_supports("pclmul") &&
+               __builtin_cpu_supports("ssse3");
+#else
+        return false;
+#endif
+    default:
+        return false;
+    }
+}
+
+Kernel
+active_kernel()
+{
+    static const Kernel s_kernel = supported(PCLMUL) ? PCLMUL : SLICING_16;
+    return s_kernel;
+}
+
+const char *
+kernel_name(Kernel kernel)
+{
+    switch(kernel)
+    {
+    case TABLE:
+        return "table";
+    case SLICING_8:
+        return "slicing-by-8";
+    case SLICING_16:
+        return "slicing-by-16";
+    case PCLMUL:
+        return "pclmul";
+    default:
+        return "?";
+    }
+}
+
+typedef uint16_t (*CopyFn)(uint16_t, uint8_t *, const uint8_t *, size_t);
+
+template <bool Copy>
+static CopyFn
+kernel_function(Kernel kernel)
+{
+    switch(kernel)
+    {
+    case TABLE:
+        return update_table<Copy>;
+    case SLICING_8:
+        return update_slicing<8, Copy>;
+#ifdef CRC16_HAS_PCLMUL
+    case PCLMUL:
+        if(supported(PCLMUL))
+            return update_pclmul<Copy>;
+        return update_slicing<16, Copy>;
+#endif
+    default:
+        return update_slicing<16, Copy>;
+    }
+}
+
+uint16_t
+update(Kernel kernel, uint16_t crc, const uint8_t *buf, size_t n)
+{
+    return kernel_function<false>(kernel)(crc, nullptr, buf, n);
+}
+
+uint16_t
+update(uint16_t crc, const uint8_t *buf, size_t n)
+{
+    static const CopyFn s_update = kernel_function<false>(active_kernel());
+    return s_update(crc, nullptr, buf, n);
+}
+
+uint16_t
+update_copy(Kernel kernel,
+            uint16_t crc,
+            uint8_t *dst,
+            const uint8_t *src,
+            size_t n)
+{
+    return kernel_function<true>(kernel)(crc, dst, src, n);
+}
+
+uint16_t
+update_copy(uint16_t crc, uint8_t *dst, const uint8_t *src, size_t n)
+{
+    static const CopyFn s_update_copy = kernel_function<true>(active_kernel());
+    return s_update_copy(crc, dst, src, n);
+}
+
+typedef void (*UpdateX4Fn)(uint16_t[4], const uint8_t *const[4], size_t);
+
+static UpdateX4Fn
+kernel_function_x4(Kernel kernel)
+{
+    switch(kernel)
+    {
+    case TABLE:
+        return update_table_x4;
+    case SLICING_8:
+        return update_slicing_x4<8>;
+#ifdef CRC16_HAS_PCLMUL
+    case PCLMUL:
+        if(supported(PCLMUL))
+            return update_pclmul_x4;
+        return update_slicing_x4<16>;
+#endif
+    default:
+        return update_slicing_x4<16>;
+    }
+}
+
+void
+update_x4(Kernel kernel, uint16_t crc[4], const uint8_t *const buf[4], size_t n)
+{
+    kernel_function_x4(kernel)(crc, buf, n);
+}
+
+void
+update_x4(uint16_t crc[4], const uint8_t *const buf[4], size_t n)
+{
+    static const UpdateX4Fn s_update_x4 = kernel_function_x4(active_kernel());
+    s_update_x4(crc, buf, n);
+}
+
+} // namespace CRC16
+
+/**
+ * @brief Check frames 4 by 4 with update_x4 on the part the 4 frames have in
+ * common, the end of the longer ones is finished one by one.
+ * frame(i) and size(i) give the address and the size of frame i.
+ */
+template <typename Frame, typename Size>
+static size_t
+check_frames_x4(const CRCSpec &spec,
+                Frame frame,
+                Size size,
+                size_t n_frames,
+                uint64_t *valid)
+{
+    memset(valid, 0, (n_frames + 63) / 64 * sizeof(uint64_t));
+    size_t n_valid = 0;
+    for(size_t i = 0; i < n_frames; i += 4)
+    {
+        int n_lanes = n_frames - i < 4 ? n_frames - i : 4;
+        const uint8_t *buf[4];
+        size_t body[4];
+        uint16_t crc[4];
+        size_t common = SIZE_MAX;
+        for(int l = 0; l < 4; l++)
+        {
+            // missing lanes hash the first frame again, their result is unused
+            size_t j = i + (l < n_lanes ? l : 0);
+            buf[l] = frame(j);
+            body[l] = size(j) < 2 ? 0 : size(j) - 2;
+            crc[l] = spec.init;
+            common = body[l] < common ? body[l] : common;
+        }
+        spec.update_x4(crc, buf, common);
+        for(int l = 0; l < n_lanes; l++)
+        {
+            crc[l] = spec.update(crc[l], buf[l] + common, body[l] - common);
+            if(size(i + l) >= 2 && spec.verify(crc[l], buf[l] + body[l]))
+            {
+                valid[(i + l) / 64] |= (uint64_t)1 << ((i + l) % 64);
+                n_valid++;
+            }
+        }
+    }
+    return n_valid;
+}
+
+size_t
+CRCSpec::check_frames(const uint8_t *frames,
+                      size_t frame_size,
+                      size_t n_frames,
+                      uint64_t *valid) const
+{
+    return check_frames_x4(
+        *this, [=](size_t i) { return frames + i * frame_size; },
+        [=](size_t) { return frame_size; }, n_frames, valid);
+}
+
+size_t
+CRCSpec::check_frames(const uint8_t *const *frames,
+                      const size_t *sizes,
+                      size_t n_frames,
+                      uint64_t *valid) const
+{
+    return check_frames_x4(
+        *this, [=](size_t i) { return frames[i]; },
+        [=](size_t i) { return sizes[i]; }, n_frames, valid);
+}
+
+} // namespace Communication
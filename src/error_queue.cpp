@@ -0,0 +1,76 @@
+#include "error_queue.hpp"
+#include "timestamping.hpp"
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+// reports kept for an owner that does not read them, the oldest go first
+#define MAX_REPORTS 4096
+
+namespace Communication
+{
+
+std::vector<ErrorQueue::Completion>
+ErrorQueue::take_completions()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    read();
+    std::vector<Completion> completions;
+    completions.swap(m_completions);
+    return completions;
+}
+
+std::vector<ErrorQueue::Timestamp>
+ErrorQueue::take_timestamps()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    read();
+    std::vector<Timestamp> timestamps;
+    timestamps.swap(m_timestamps);
+    return timestamps;
+}
+
+void
+ErrorQueue::read()
+{
+#ifdef __linux__
+    while(m_fd >= 0)
+    {
+        char control[256];
+        struct msghdr msg = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if(recvmsg(m_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            return; // EAGAIN: queue empty
+
+        const struct sock_extended_err *ee = nullptr;
+        for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+            cm = CMSG_NXTHDR(&msg, cm))
+            if((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+               (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+                ee = (const struct sock_extended_err *)CMSG_DATA(cm);
+        if(!ee)
+            continue;
+        if(ee->ee_origin == SO_EE_ORIGIN_ZEROCOPY && ee->ee_errno == 0 &&
+           m_want_completions)
+        {
+            bool copied = ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED;
+            m_completions.push_back({ee->ee_info, ee->ee_data, copied});
+        }
+        else if(ee->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && m_want_timestamps)
+        {
+            // the same SCM_TIMESTAMPING message as on the receive side
+            int64_t ns = Timestamping::rx_timestamp(control, msg.msg_controllen);
+            if(ns)
+                m_timestamps.push_back({ee->ee_info, ee->ee_data, ns});
+            if(m_timestamps.size() > MAX_REPORTS)
+                m_timestamps.erase(m_timestamps.begin());
+        }
+    }
+#endif
+}
+
+} // namespace Communication
@@ -0,0 +1,63 @@
+#include "fifo_limits.hpp"
+
+#include <algorithm>
+
+namespace Communication
+{
+
+MemoryBudget &
+MemoryBudget::instance()
+{
+    static MemoryBudget s_budget;
+    return s_budget;
+}
+
+void
+MemoryBudget::add(long delta)
+{
+    if(delta == 0)
+        return;
+    size_t used = m_used += (size_t)delta; // wraps back for negative deltas
+    size_t high = m_high_water;
+    while(delta > 0 && used > high &&
+          !m_high_water.compare_exchange_weak(high, used))
+        ;
+}
+
+FifoLimits::Admission
+FifoLimits::admit(size_t size, size_t n, bool can_pause) const
+{
+    Admission a;
+    size_t room = capacity == 0      ? SIZE_MAX
+                  : size < capacity ? capacity - size
+                                    : 0;
+    room = std::min(room, MemoryBudget::instance().room());
+    Policy p = policy == PAUSE && !can_pause ? DROP_NEWEST : policy;
+    if(n <= room)
+    {
+        a.store = n;
+        // full after this chunk: stop before the next one
+        a.pause = p == PAUSE && n == room;
+        return a;
+    }
+    switch(p)
+    {
+    case PAUSE: // the bytes are out of the socket already, keep them
+        a.store = n;
+        a.pause = true;
+        break;
+    case DROP_OLDEST:
+        a.drop_oldest = std::min(size, n - room);
+        a.store = std::min(n, room + a.drop_oldest);
+        break;
+    case DROP_NEWEST:
+        a.store = room;
+        break;
+    case DISCONNECT:
+        a.disconnect = true;
+        break;
+    }
+    return a;
+}
+
+} // namespace Communication
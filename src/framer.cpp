@@ -0,0 +1,125 @@
+#include "framer.hpp"
+
+#include <stdexcept>
+
+namespace Communication
+{
+
+Framer
+Framer::fixed(size_t size, bool has_crc)
+{
+    if(size == 0 || (has_crc && size < 2))
+        throw std::invalid_argument("Framer: frame too small");
+    Framer framer(FIXED, has_crc, size);
+    framer.m_size = size;
+    return framer;
+}
+
+Framer
+Framer::length_prefix(int width, bool big_endian, bool has_crc, size_t max_size)
+{
+    if(width != 1 && width != 2 && width != 4 && width != 8)
+        throw std::invalid_argument("Framer: invalid length width");
+    Framer framer(LENGTH_PREFIX, has_crc, max_size);
+    framer.m_width = width;
+    framer.m_big_endian = big_endian;
+    return framer;
+}
+
+Framer
+Framer::delimiter(const std::string &delimiter, bool has_crc, size_t max_size)
+{
+    if(delimiter.empty())
+        throw std::invalid_argument("Framer: empty delimiter");
+    Framer framer(DELIMITER, has_crc, max_size);
+    framer.m_delimiter = delimiter;
+    return framer;
+}
+
+size_t
+Framer::max_wire_size() const
+{
+    switch(m_mode)
+    {
+    case FIXED:
+        return m_size;
+    case LENGTH_PREFIX:
+        return m_width + m_max_size + (m_has_crc ? 2 : 0);
+    case DELIMITER:
+        break;
+    }
+    return m_max_size;
+}
+
+size_t
+Framer::wire_size(const RingBuffer &fifo)
+{
+    switch(m_mode)
+    {
+    case FIXED:
+        return fifo.size() >= m_size ? m_size : 0;
+    case LENGTH_PREFIX:
+    {
+        if(fifo.size() < (size_t)m_width)
+            return 0;
+        uint64_t len = 0;
+        for(int i = 0; i < m_width; i++)
+            len = (len << 8) | fifo[m_big_endian ? i : m_width - 1 - i];
+        if(len > m_max_size)
+            return RingBuffer::npos;
+        size_t wire = m_width + len + (m_has_crc ? 2 : 0);
+        return fifo.size() >= wire ? wire : 0;
+    }
+    case DELIMITER:
+        break;
+    }
+
+    // only search the bytes received since the last call
+    size_t n = m_delimiter.size();
+    size_t pos = fifo.find((const uint8_t *)m_delimiter.data(), n, m_scanned);
+    if(pos == RingBuffer::npos)
+    {
+        if(fifo.size() >= m_max_size)
+            return RingBuffer::npos;
+        m_scanned = fifo.size() >= n ? fifo.size() - n + 1 : 0;
+        return 0;
+    }
+    m_scanned = 0;
+    return pos + n > m_max_size ? RingBuffer::npos : pos + n;
+}
+
+Framer::Status
+Framer::next(RingBuffer &fifo, const uint8_t *&frame, size_t &size)
+{
+    size_t wire = wire_size(fifo);
+    if(wire == 0)
+        return INCOMPLETE;
+    if(wire == RingBuffer::npos)
+    {
+        // no way to find the start of the next frame
+        fifo.clear();
+        reset();
+        return OVERSIZED;
+    }
+
+    // zero copy unless the frame wraps around the end of the FIFO
+    size_t len;
+    const uint8_t *p = fifo.read_ptr(len);
+    if(len < wire)
+    {
+        m_scratch.resize(wire);
+        fifo.peek(m_scratch.data(), wire);
+        p = m_scratch.data();
+    }
+    fifo.consume(wire);
+
+    size_t header = m_mode == LENGTH_PREFIX ? m_width : 0;
+    size_t body = wire - (m_mode == DELIMITER ? m_delimiter.size() : 0);
+    if(m_has_crc && (body < header + 2 || !m_crc.check(p, body)))
+        return BAD_CRC;
+    frame = p + header;
+    size = body - header - (m_has_crc ? 2 : 0);
+    return FRAME;
+}
+
+} // namespace Communication
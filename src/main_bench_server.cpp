@@ -0,0 +1,145 @@
+/**
+ * @file main_bench_server.cpp
+ * @brief Loopback benchmark of the TCPServer/UDPServer receive engines.
+ *
+ * Clients stream data to a local server for each engine (THREADS, REACTOR,
+ * IO_URING) and the receive throughput and number of receive syscalls
+ * made by the server are reported.
+ *
+ * Usage:
+ *   ./demo_com_client_bench_server [n_clients] [MB_per_client] [chunk_size]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "tcp_client.hpp"
+#include "udp_client.hpp"
+
+using namespace Communication;
+
+static const char *
+engine_name(Server::Engine engine)
+{
+    switch(engine)
+    {
+    case Server::THREADS:
+        return "threads";
+    case Server::REACTOR:
+        return "reactor";
+    case Server::IO_URING:
+        return URing::supported() ? "io_uring" : "io_uring (fallback)";
+    }
+    return "?";
+}
+
+static void
+report(const char *proto,
+       Server::Engine engine,
+       Server &server,
+       uint64_t expected,
+       double seconds)
+{
+    uint64_t bytes = server.rx_bytes();
+    uint64_t syscalls = server.rx_syscalls();
+    printf("%-4s %-20s %8.1f MB/s  %10llu syscalls  %8.2f syscalls/MB  "
+           "(%llu/%llu bytes)\n",
+           proto, engine_name(engine), bytes / seconds / 1e6,
+           (unsigned long long)syscalls,
+           syscalls / (bytes / (1024.0 * 1024.0)),
+           (unsigned long long)bytes, (unsigned long long)expected);
+}
+
+static void
+bench_tcp(Server::Engine engine, int port, int n_clients, size_t per_client,
+          size_t chunk)
+{
+    TCPServer server(port, 128, -1);
+    server.set_engine(engine, 2);
+    // nobody reads the FIFOs here, drop the data as it comes
+    server.set_callback(
+        [](Server *srv, uint8_t *, size_t, void *addr, void *)
+        { static_cast<TCPServer *>(srv)->clear_fifo(*(SOCKET *)addr); });
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    uint64_t expected = (uint64_t)n_clients * per_client;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for(int i = 0; i < n_clients; i++)
+        clients.emplace_back(
+            [=]()
+            {
+                TCP client(-1);
+                client.open_connection("127.0.0.1", port, 2);
+                std::vector<uint8_t> data(chunk, 0x55);
+                for(size_t sent = 0; sent < per_client; sent += chunk)
+                    client.writeS(data.data(), chunk);
+                client.close_connection();
+            });
+    for(auto &t : clients) t.join();
+    while(server.rx_bytes() < expected &&
+          std::chrono::steady_clock::now() - start < std::chrono::seconds(30))
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    report("tcp", engine, server, expected, seconds);
+    server.stop();
+}
+
+static void
+bench_udp(Server::Engine engine, int port, int n_clients, size_t per_client,
+          size_t chunk)
+{
+    UDPServer server(port, 128, -1);
+    server.set_engine(engine);
+    server.set_callback([](Server *, uint8_t *, size_t, void *, void *) {});
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // datagrams may be dropped under load: count what was sent
+    uint64_t expected = (uint64_t)n_clients * per_client;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for(int i = 0; i < n_clients; i++)
+        clients.emplace_back(
+            [=]()
+            {
+                UDP client(-1);
+                client.open_connection("127.0.0.1", port, 0);
+                std::vector<uint8_t> data(chunk, 0x55);
+                for(size_t sent = 0; sent < per_client; sent += chunk)
+                    client.writeS(data.data(), chunk);
+                client.close_connection();
+            });
+    for(auto &t : clients) t.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    report("udp", engine, server, expected, seconds);
+    server.stop();
+}
+
+int
+main(int argc, char **argv)
+{
+    int n_clients = argc > 1 ? atoi(argv[1]) : 8;
+    size_t per_client = (argc > 2 ? atoi(argv[2]) : 16) * 1024 * 1024;
+    size_t chunk = argc > 3 ? atoi(argv[3]) : 256;
+    std::cout << n_clients << " clients x " << per_client / (1024 * 1024)
+              << " MB, " << chunk << " bytes per write" << std::endl;
+
+    int port = 19500;
+    for(Server::Engine engine :
+        {Server::THREADS, Server::REACTOR, Server::IO_URING})
+        bench_tcp(engine, port++, n_clients, per_client, chunk);
+    for(Server::Engine engine : {Server::THREADS, Server::IO_URING})
+        bench_udp(engine, port++, n_clients, per_client / 16, chunk);
+    return 0;
+}
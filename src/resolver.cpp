@@ -0,0 +1,196 @@
+#include "resolver.hpp"
+
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#endif
+
+namespace Communication
+{
+
+typedef std::chrono::steady_clock Clock;
+
+struct Resolver::Cache
+{
+    struct Entry
+    {
+        Resolution resolution;
+        Clock::time_point expires;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_map<std::string, std::shared_future<Resolution>> pending;
+    std::chrono::seconds ttl;
+    std::chrono::seconds negative_ttl;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+};
+
+std::vector<sockaddr_storage>
+Resolution::with_port(int port, int family) const
+{
+    std::vector<sockaddr_storage> out;
+    for(const sockaddr_storage &addr : addrs)
+    {
+        if(family != AF_UNSPEC && addr.ss_family != family)
+            continue;
+        out.push_back(addr);
+        if(addr.ss_family == AF_INET6)
+            ((sockaddr_in6 *)&out.back())->sin6_port = htons(port);
+        else
+            ((sockaddr_in *)&out.back())->sin_port = htons(port);
+    }
+    return out;
+}
+
+static Resolution
+lookup(const std::string &host, int socktype, int flags = 0)
+{
+    Resolution r;
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = socktype;
+    hints.ai_flags = flags;
+    struct addrinfo *res;
+    int err = getaddrinfo(host.c_str(), nullptr, &hints, &res);
+    if(err != 0)
+    {
+        r.error = gai_strerror(err);
+        return r;
+    }
+    for(struct addrinfo *ai = res; ai; ai = ai->ai_next)
+    {
+        sockaddr_storage addr = {};
+        memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+        r.addrs.push_back(addr);
+    }
+    freeaddrinfo(res);
+    return r;
+}
+
+static std::shared_future<Resolution>
+ready(const Resolution &r)
+{
+    std::promise<Resolution> promise;
+    promise.set_value(r);
+    return promise.get_future().share();
+}
+
+Resolver &
+Resolver::instance()
+{
+    static Resolver s_resolver;
+    return s_resolver;
+}
+
+Resolver::Resolver(int ttl_s, int negative_ttl_s) : m_cache(new Cache())
+{
+    set_ttl(ttl_s, negative_ttl_s);
+}
+
+void
+Resolver::set_ttl(int ttl_s, int negative_ttl_s)
+{
+    std::lock_guard<std::mutex> lock(m_cache->mutex);
+    m_cache->ttl = std::chrono::seconds(ttl_s);
+    m_cache->negative_ttl = std::chrono::seconds(negative_ttl_s);
+}
+
+void
+Resolver::clear()
+{
+    std::lock_guard<std::mutex> lock(m_cache->mutex);
+    m_cache->entries.clear();
+}
+
+uint64_t
+Resolver::hits() const
+{
+    return m_cache->hits;
+}
+
+uint64_t
+Resolver::misses() const
+{
+    return m_cache->misses;
+}
+
+Resolution
+Resolver::resolve(const std::string &host, int socktype)
+{
+    return resolve_async(host, socktype).get();
+}
+
+std::shared_future<Resolution>
+Resolver::resolve_async(const std::string &host, int socktype)
+{
+    // numeric addresses do not need the DNS
+    Resolution numeric = lookup(host, socktype, AI_NUMERICHOST);
+    if(numeric.error.empty())
+        return ready(numeric);
+
+    std::string key = host + "/" + std::to_string(socktype);
+    std::lock_guard<std::mutex> lock(m_cache->mutex);
+    auto it = m_cache->entries.find(key);
+    if(it != m_cache->entries.end())
+    {
+        const Cache::Entry &entry = it->second;
+        bool fresh = Clock::now() < entry.expires;
+        if(fresh || entry.resolution.error.empty())
+        {
+            m_cache->hits++;
+            if(!fresh) // serve the stale answer, refresh it in the background
+                start_lookup(m_cache, key, host, socktype);
+            return ready(entry.resolution);
+        }
+    }
+    m_cache->misses++;
+    return start_lookup(m_cache, key, host, socktype);
+}
+
+std::shared_future<Resolution>
+Resolver::start_lookup(const std::shared_ptr<Cache> &cache,
+                       const std::string &key,
+                       const std::string &host,
+                       int socktype)
+{
+    auto it = cache->pending.find(key);
+    if(it != cache->pending.end())
+        return it->second;
+
+    std::shared_ptr<std::promise<Resolution>> promise(
+        new std::promise<Resolution>());
+    std::shared_future<Resolution> future = promise->get_future().share();
+    cache->pending[key] = future;
+    std::thread(
+        [cache, key, host, socktype, promise]()
+        {
+            Resolution r = lookup(host, socktype);
+            {
+                std::lock_guard<std::mutex> lock(cache->mutex);
+                auto it = cache->entries.find(key);
+                Clock::time_point expires =
+                    Clock::now() +
+                    (r.error.empty() ? cache->ttl : cache->negative_ttl);
+                // a failed refresh keeps the last good answer, which is not
+                // refreshed again before the negative TTL
+                if(r.error.empty() || it == cache->entries.end() ||
+                   !it->second.resolution.error.empty())
+                    cache->entries[key] = {r, expires};
+                else
+                    it->second.expires = expires;
+                cache->pending.erase(key);
+            }
+            promise->set_value(r);
+        })
+        .detach();
+    return future;
+}
+
+} // namespace Communication
@@ -0,0 +1,148 @@
+#include "ring_buffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Communication
+{
+
+static size_t
+next_pow2(size_t n)
+{
+    size_t p = 1;
+    while(p < n) p <<= 1;
+    return p;
+}
+
+RingBuffer::RingBuffer(size_t capacity, size_t max_capacity)
+    : m_data(next_pow2(std::max<size_t>(capacity, 1))),
+      m_mask(m_data.size() - 1)
+{
+    set_max_capacity(max_capacity);
+}
+
+void
+RingBuffer::set_max_capacity(size_t max_capacity)
+{
+    m_max_capacity = std::max(max_capacity, capacity());
+}
+
+void
+RingBuffer::grow(size_t min_capacity)
+{
+    size_t new_capacity = capacity();
+    while(new_capacity < min_capacity && new_capacity <= m_max_capacity / 2)
+        new_capacity <<= 1;
+    if(new_capacity == capacity())
+        return;
+
+    std::vector<uint8_t> data(new_capacity);
+    size_t n = size();
+    peek(data.data(), n);
+    m_data.swap(data);
+    m_mask = new_capacity - 1;
+    m_head = 0;
+    m_tail = n;
+}
+
+bool
+RingBuffer::reserve(size_t n)
+{
+    if(available() < n)
+        grow(size() + n);
+    return available() >= n;
+}
+
+size_t
+RingBuffer::push(const uint8_t *data, size_t n)
+{
+    reserve(n);
+    n = std::min(n, available());
+    size_t pos = m_tail & m_mask;
+    size_t first = std::min(n, capacity() - pos);
+    memcpy(&m_data[pos], data, first);
+    memcpy(&m_data[0], data + first, n - first);
+    m_tail += n;
+    return n;
+}
+
+size_t
+RingBuffer::peek(uint8_t *data, size_t n, size_t offset) const
+{
+    if(offset >= size())
+        return 0;
+    n = std::min(n, size() - offset);
+    size_t pos = (m_head + offset) & m_mask;
+    size_t first = std::min(n, capacity() - pos);
+    memcpy(data, &m_data[pos], first);
+    memcpy(data + first, &m_data[0], n - first);
+    return n;
+}
+
+size_t
+RingBuffer::find(const uint8_t *pattern, size_t n, size_t offset) const
+{
+    if(n == 0 || size() < n)
+        return npos;
+    // memchr on the first byte, segment by segment, then compare the rest
+    for(size_t i = offset; i + n <= size();)
+    {
+        size_t pos = (m_head + i) & m_mask;
+        size_t len = std::min(size() - i, capacity() - pos);
+        const uint8_t *p = (const uint8_t *)memchr(&m_data[pos], pattern[0], len);
+        if(!p)
+        {
+            i += len;
+            continue;
+        }
+        i += p - &m_data[pos];
+        if(i + n > size())
+            break;
+        size_t k = 1;
+        while(k < n && (*this)[i + k] == pattern[k]) k++;
+        if(k == n)
+            return i;
+        i++;
+    }
+    return npos;
+}
+
+size_t
+RingBuffer::consume(size_t n)
+{
+    n = std::min(n, size());
+    m_head += n;
+    if(m_head == m_tail) // restart at the beginning to keep data contiguous
+        m_head = m_tail = 0;
+    return n;
+}
+
+size_t
+RingBuffer::pop(uint8_t *data, size_t n)
+{
+    return consume(peek(data, n));
+}
+
+const uint8_t *
+RingBuffer::read_ptr(size_t &n) const
+{
+    size_t pos = m_head & m_mask;
+    n = std::min(size(), capacity() - pos);
+    return &m_data[pos];
+}
+
+uint8_t *
+RingBuffer::write_ptr(size_t &n)
+{
+    size_t pos = m_tail & m_mask;
+    n = std::min(available(), capacity() - pos);
+    return &m_data[pos];
+}
+
+void
+RingBuffer::commit(size_t n)
+{
+    m_tail += std::min(n, available());
+}
+
+} // namespace Communication
@@ -0,0 +1,164 @@
+#include "send_queue.hpp"
+
+#include <errno.h>
+
+#if defined(linux) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#elif defined(_WIN32)
+#include <winsock2.h>
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS (MSG_NOSIGNAL | MSG_DONTWAIT)
+#elif defined(MSG_DONTWAIT)
+#define SEND_FLAGS MSG_DONTWAIT
+#else
+#define SEND_FLAGS 0
+#endif
+
+// segments sent by one sendmsg()
+#define MAX_IOV 64
+
+namespace Communication
+{
+
+SharedBuffer
+make_shared_buffer(const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    return std::make_shared<const std::vector<uint8_t>>(bytes, bytes + size);
+}
+
+SendQueue::Status
+SendQueue::push(SharedBuffer buffer, Callback callback, void *data)
+{
+    size_t size = buffer->size();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Segment segment = {std::move(buffer), 0, callback, data};
+    if(size == 0)
+    {
+        done(segment, true);
+        return QUEUED;
+    }
+    if(m_bytes != 0 && m_bytes + size > m_limit)
+    {
+        if(m_policy != COALESCE)
+        {
+            m_dropped++;
+            done(segment, false);
+            return m_policy == DISCONNECT ? OVERFLOW : DROPPED;
+        }
+        // keep the message being sent, a partial one would break the stream
+        size_t keep = !m_segments.empty() && m_segments.front().offset ? 1 : 0;
+        m_dropped += m_segments.size() - keep;
+        for(size_t i = keep; i < m_segments.size(); i++)
+            done(m_segments[i], false);
+        m_segments.resize(keep);
+        m_bytes = keep ? m_segments.front().buffer->size() -
+                             m_segments.front().offset
+                       : 0;
+    }
+    m_segments.push_back(std::move(segment));
+    m_bytes += size;
+    return QUEUED;
+}
+
+long
+SendQueue::drain(int fd)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    long total = 0;
+    while(!m_segments.empty())
+    {
+#if defined(linux) || defined(__APPLE__)
+        struct iovec iov[MAX_IOV];
+        size_t n_iov = 0;
+        for(auto it = m_segments.begin();
+            it != m_segments.end() && n_iov < MAX_IOV; ++it, ++n_iov)
+        {
+            iov[n_iov].iov_base = (void *)(it->buffer->data() + it->offset);
+            iov[n_iov].iov_len = it->buffer->size() - it->offset;
+        }
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n_iov;
+        ssize_t n = sendmsg(fd, &msg, SEND_FLAGS);
+#else
+        Segment &front = m_segments.front();
+        long n = ::send(fd, (const char *)front.buffer->data() + front.offset,
+                        (int)(front.buffer->size() - front.offset), 0);
+#endif
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break; // socket buffer full, the rest waits
+            for(const Segment &segment : m_segments) done(segment, false);
+            m_segments.clear();
+            m_bytes = 0;
+            m_empty_cv.notify_all();
+            return -1;
+        }
+        total += n;
+        m_bytes -= n;
+        // pop the segments fully sent, the last one may be partial
+        for(size_t left = n; left > 0;)
+        {
+            Segment &front = m_segments.front();
+            size_t rest = front.buffer->size() - front.offset;
+            if(left < rest)
+            {
+                front.offset += left;
+                break;
+            }
+            left -= rest;
+            done(front, true);
+            m_segments.pop_front();
+        }
+    }
+    if(m_segments.empty())
+        m_empty_cv.notify_all();
+    return total;
+}
+
+void
+SendQueue::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const Segment &segment : m_segments) done(segment, false);
+    m_segments.clear();
+    m_bytes = 0;
+    m_empty_cv.notify_all();
+}
+
+void
+SendQueue::complete()
+{
+    std::vector<Completion> completed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_done.empty())
+            return;
+        completed.swap(m_done);
+    }
+    for(const Completion &c : completed) c.callback(c.data, c.sent);
+}
+
+bool
+SendQueue::wait_empty(std::chrono::steady_clock::time_point deadline)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_empty_cv.wait_until(lock, deadline,
+                                 [&]() { return m_segments.empty(); });
+}
+
+void
+SendQueue::done(const Segment &segment, bool sent)
+{
+    if(segment.callback)
+        m_done.push_back({segment.callback, segment.data, sent});
+}
+
+} // namespace Communication
@@ -250,13 +250,27 @@ Serial::open_connection(const char *path, int baud, int flags)
 int
 Serial::readS(uint8_t *buffer, size_t size, bool has_crc, bool read_until)
 {
-    std::lock_guard<std::mutex> lck(*m_mutex); // Ensure only one thread uses it
+    std::lock_guard<std::mutex> lck(m_rx_mutex); // Ensure only one thread uses it
     if(m_is_connected)
     {
+        if(m_rx_buffer)
+            return read_buffered(buffer, size, has_crc, read_until);
+
+        // the CRC is accumulated as the chunks arrive (see update_CRC)
+        CRCAccumulator crc(m_crc);
 #if defined(__linux__) || defined(__APPLE__)
         ssize_t n = read(m_fd, buffer, size);
+        m_rx_syscalls++;
+        if(has_crc && n > 0)
+            update_CRC(crc, buffer, size, n);
         if((size_t)n != size && read_until)
-            while((size_t)n != size) n += read(m_fd, buffer + n, size - n);
+            while((size_t)n != size)
+            {
+                n += read(m_fd, buffer + n, size - n);
+                m_rx_syscalls++;
+                if(has_crc && n > 0)
+                    update_CRC(crc, buffer, size, n);
+            }
 #elif _WIN32
         DWORD n = 0;
         if(!ReadFile((HANDLE)m_fd, buffer, size, &n, NULL))
@@ -272,7 +286,7 @@ Serial::readS(uint8_t *buffer, size_t size, bool has_crc, bool read_until)
 #endif
 
         if(has_crc)
-            return check_CRC(buffer, size) ? n : -1;
+            return finish_CRC(crc, buffer, size) ? n : -1;
         return n;
     }
     return -1;
@@ -281,12 +295,11 @@ Serial::readS(uint8_t *buffer, size_t size, bool has_crc, bool read_until)
 int
 Serial::writeS(const void *buffer, size_t size, bool add_crc)
 {
-    std::lock_guard<std::mutex> lck(*m_mutex); // Ensure only one thread uses it
+    std::lock_guard<std::mutex> lck(m_tx_mutex); // Ensure only one thread uses it
     if(m_is_connected)
     {
         if(add_crc)
-            *(uint16_t *)((uint8_t *)buffer + size) =
-                CRC((uint8_t *)buffer, size); // Add CRC
+            append_CRC((uint8_t *)buffer, size); // Add CRC
 #if defined(__linux__) || defined(__APPLE__)
         return write(m_fd, buffer, size + 2 * add_crc);
 #elif _WIN32
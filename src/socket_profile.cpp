@@ -0,0 +1,156 @@
+#include "socket_profile.hpp"
+
+#include <iterator>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace Communication
+{
+
+/**
+ * @brief Level, name and field of each option. Options unknown to the
+ * platform get a negative name and are skipped.
+ */
+struct Option
+{
+    const char *name;
+    int level;
+    int optname;
+    int SocketProfile::*field;
+    bool stream_only; // TCP option
+};
+
+#ifndef TCP_QUICKACK
+#define TCP_QUICKACK -1
+#endif
+#ifndef TCP_NOTSENT_LOWAT
+#define TCP_NOTSENT_LOWAT -1
+#endif
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL -1
+#endif
+#ifndef SO_PRIORITY
+#define SO_PRIORITY -1
+#endif
+
+static const Option s_options[] = {
+    {"rcvbuf", SOL_SOCKET, SO_RCVBUF, &SocketProfile::rcvbuf, false},
+    {"sndbuf", SOL_SOCKET, SO_SNDBUF, &SocketProfile::sndbuf, false},
+    {"nodelay", IPPROTO_TCP, TCP_NODELAY, &SocketProfile::nodelay, true},
+    {"quickack", IPPROTO_TCP, TCP_QUICKACK, &SocketProfile::quickack, true},
+    {"notsent_lowat", IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+     &SocketProfile::notsent_lowat, true},
+    {"busy_poll", SOL_SOCKET, SO_BUSY_POLL, &SocketProfile::busy_poll, false},
+    {"priority", SOL_SOCKET, SO_PRIORITY, &SocketProfile::priority, false},
+    {"tos", IPPROTO_IP, IP_TOS, &SocketProfile::tos, false},
+    {"rcvlowat", SOL_SOCKET, SO_RCVLOWAT, &SocketProfile::rcvlowat, false},
+};
+
+/**
+ * @brief Options of a socket: the TCP ones only apply to stream sockets, and
+ * IPv6 sockets take IPV6_TCLASS instead of IP_TOS.
+ */
+static std::vector<Option>
+socket_options(int fd)
+{
+    std::vector<Option> options(std::begin(s_options), std::end(s_options));
+    int type = 0;
+    socklen_t len = sizeof(type);
+    getsockopt(fd, SOL_SOCKET, SO_TYPE, (char *)&type, &len);
+    sockaddr_storage addr = {};
+    len = sizeof(addr);
+    bool ipv6 = getsockname(fd, (sockaddr *)&addr, &len) == 0 &&
+                addr.ss_family == AF_INET6;
+    for(Option &option : options)
+    {
+        if(option.stream_only && type != SOCK_STREAM)
+            option.optname = -1;
+        if(ipv6 && option.field == &SocketProfile::tos)
+        {
+            option.level = IPPROTO_IPV6;
+            option.optname = IPV6_TCLASS;
+        }
+    }
+    return options;
+}
+
+SocketProfile
+SocketProfile::low_latency()
+{
+    SocketProfile p;
+    p.nodelay = 1;
+    p.quickack = 1;
+    p.notsent_lowat = 16 * 1024;
+    p.busy_poll = 50;
+    p.priority = 6;
+    p.tos = 0x10; // IPTOS_LOWDELAY
+    return p;
+}
+
+SocketProfile
+SocketProfile::bulk_throughput()
+{
+    SocketProfile p;
+    p.rcvbuf = 4 * 1024 * 1024;
+    p.sndbuf = 4 * 1024 * 1024;
+    p.nodelay = 0;
+    p.tos = 0x08; // IPTOS_THROUGHPUT
+    return p;
+}
+
+void
+SocketProfile::apply(int fd) const
+{
+    bool empty = true;
+    for(const Option &option : s_options)
+        empty = empty && this->*option.field < 0;
+    if(empty)
+        return;
+    for(const Option &option : socket_options(fd))
+    {
+        int value = this->*option.field;
+        if(value < 0 || option.optname < 0)
+            continue;
+        setsockopt(fd, option.level, option.optname, (const char *)&value,
+                   sizeof(value));
+    }
+}
+
+SocketProfile
+SocketProfile::query(int fd)
+{
+    SocketProfile p;
+    for(const Option &option : socket_options(fd))
+    {
+        int value = -1;
+        socklen_t len = sizeof(value);
+        if(option.optname < 0 ||
+           getsockopt(fd, option.level, option.optname, (char *)&value, &len) <
+               0)
+            value = -1;
+        p.*option.field = value;
+    }
+    return p;
+}
+
+std::string
+SocketProfile::to_string() const
+{
+    std::string s;
+    for(const Option &option : s_options)
+        if(this->*option.field >= 0)
+            s += std::string(s.empty() ? "" : " ") + option.name + "=" +
+                 std::to_string(this->*option.field);
+    return s;
+}
+
+} // namespace Communication
@@ -1,5 +1,15 @@
 #include "tcp_client.hpp"
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#if defined(__linux__) || defined(__APPLE__)
+#include <poll.h>
+#endif
+
 namespace Communication
 {
 
@@ -11,25 +21,29 @@ int
 TCP::open_connection(const char *address, int port, int timeout)
 {
     m_ip = address;
-    SOCKADDR_IN sin = {0,0,0,0};
 #ifdef __linux__
-    struct hostent *hostinfo;
     TIMEVAL tv = {timeout,0};
     int res;
     set_cli_id(cli_id() + ((cli_id() == "") ? "" : " - ") +
                fstr_link(std::string(address) + ":" + std::to_string(port)));
 
-    m_fd = socket(AF_INET, SOCK_STREAM, 0);
+    // cached, a reconnection does not wait on the DNS
+    Resolution resolution = Resolver::instance().resolve(address, SOCK_STREAM);
+    std::vector<sockaddr_storage> addrs = resolution.with_port(port, AF_INET);
+    if(addrs.empty()) // IPv6 only host
+        addrs = resolution.with_port(port);
+    if(addrs.empty())
+        throw log_error(std::string("Unknown host ") + address + " [" +
+                        resolution.error + "]");
+    sockaddr_storage &sin = addrs[0];
+    socklen_t sin_len = sin.ss_family == AF_INET6 ? sizeof(sockaddr_in6)
+                                                  : sizeof(sockaddr_in);
+
+    m_fd = socket(sin.ss_family, SOCK_STREAM, 0);
     if(m_fd == INVALID_SOCKET)
         throw log_error("socket() invalid");
-
-    hostinfo = gethostbyname(address);
-    if(hostinfo == NULL)
-        throw log_error(std::string("Unknown host") + address);
-
-    sin.sin_addr = *(IN_ADDR *)hostinfo->h_addr;
-    sin.sin_port = htons(port);
-    sin.sin_family = AF_INET;
+    // before connect(): the buffer sizes set the TCP window scale
+    m_profile.apply(m_fd);
 
     logln("Connection in progress" + fstr("...", {BLINK_SLOW}) +
               " (timeout=" + std::to_string(timeout) + "s)",
@@ -37,7 +51,7 @@ TCP::open_connection(const char *address, int port, int timeout)
 
     if(timeout != -1)
         this->SetSocketBlockingEnabled(false); //set socket non-blocking
-    res = connect(m_fd, (SOCKADDR *)&sin, sizeof(SOCKADDR)); //try to connect
+    res = connect(m_fd, (SOCKADDR *)&sin, sin_len); //try to connect
     if(timeout != -1)
         this->SetSocketBlockingEnabled(true); //set socket blocking
 
@@ -69,6 +83,9 @@ TCP::open_connection(const char *address, int port, int timeout)
             throw log_error(std::strerror(opt));
         logln(fstr("connected", {BOLD, FG_GREEN}),true);
         m_is_connected = true;
+        // the byte ids of the TX timestamps start at the connection
+        if(m_tx_stamps && !m_tx_stamps->attach(m_fd, error_queue()))
+            logln("TX timestamping not supported", true);
     }
     else
     {
@@ -106,16 +123,242 @@ TCP::open_connection(const char *address, int port, int timeout)
     return 1;
 }
 
+#if defined(__linux__) || defined(__APPLE__)
+/**
+ * @brief Addresses of a name ordered for happy eyeballs: IPv6 and IPv4
+ * alternate, starting with the family of the first getaddrinfo() answer.
+ */
+static void
+interleave(const Resolution &resolution,
+           int port,
+           std::vector<sockaddr_storage> &addrs)
+{
+    if(resolution.addrs.empty())
+        return;
+    std::vector<sockaddr_storage> by_family[2] = {
+        resolution.with_port(port, AF_INET6),
+        resolution.with_port(port, AF_INET)};
+    int first = resolution.addrs[0].ss_family == AF_INET6 ? 0 : 1;
+    for(size_t i = 0; i < by_family[0].size() || i < by_family[1].size(); i++)
+        for(int f : {first, 1 - first})
+            if(i < by_family[f].size())
+                addrs.push_back(by_family[f][i]);
+}
+#endif
+
+std::vector<TCP::ConnectResult>
+TCP::connect_all(const std::vector<Endpoint> &endpoints,
+                 int timeout_ms,
+                 int verbose)
+{
+    std::vector<ConnectResult> results(endpoints.size());
+#if defined(__linux__) || defined(__APPLE__)
+    typedef std::chrono::steady_clock Clock;
+    const auto attempt_delay = std::chrono::milliseconds(250);
+    const Clock::time_point deadline =
+        Clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    struct Target
+    {
+        std::vector<sockaddr_storage> addrs;
+        size_t next = 0; // next address to try
+        Clock::time_point next_start;
+        int in_flight = 0;
+        bool done = false;
+    };
+    struct Attempt
+    {
+        int fd;
+        size_t target;
+    };
+    std::vector<Target> targets(endpoints.size());
+    std::vector<Attempt> attempts;
+
+    // all the names are resolved in parallel, within the deadline
+    std::vector<std::shared_future<Resolution>> resolutions;
+    for(const Endpoint &endpoint : endpoints)
+        resolutions.push_back(
+            Resolver::instance().resolve_async(endpoint.address, SOCK_STREAM));
+    for(size_t i = 0; i < endpoints.size(); i++)
+    {
+        targets[i].done = true;
+        if(resolutions[i].wait_until(deadline) != std::future_status::ready)
+            results[i].error = "Name resolution timed out";
+        else if(!resolutions[i].get().error.empty())
+            results[i].error = resolutions[i].get().error;
+        else
+        {
+            interleave(resolutions[i].get(), endpoints[i].port,
+                       targets[i].addrs);
+            targets[i].done = false;
+        }
+    }
+
+    auto connected = [&](size_t i, int fd)
+    {
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+        TCP *client = new TCP(verbose);
+        client->m_ip = endpoints[i].address;
+        client->set_cli_id(client->cli_id() +
+                           ((client->cli_id() == "") ? "" : " - ") +
+                           fstr_link(endpoints[i].address + ":" +
+                                     std::to_string(endpoints[i].port)));
+        client->m_fd = fd;
+        client->m_is_connected = true;
+        results[i].client.reset(client);
+        results[i].error.clear();
+        targets[i].done = true;
+    };
+
+    while(true)
+    {
+        // start the attempts that are due
+        Clock::time_point now = Clock::now();
+        Clock::time_point wake = deadline;
+        for(size_t i = 0; i < targets.size(); i++)
+        {
+            Target &t = targets[i];
+            while(!t.done && t.next < t.addrs.size() &&
+                  (t.in_flight == 0 || now >= t.next_start))
+            {
+                sockaddr_storage &addr = t.addrs[t.next++];
+                int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+                if(fd < 0)
+                {
+                    results[i].error = strerror(errno);
+                    continue;
+                }
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                socklen_t len = addr.ss_family == AF_INET6
+                                    ? sizeof(sockaddr_in6)
+                                    : sizeof(sockaddr_in);
+                if(connect(fd, (SOCKADDR *)&addr, len) == 0)
+                    connected(i, fd);
+                else if(errno == EINPROGRESS)
+                {
+                    attempts.push_back({fd, i});
+                    t.in_flight++;
+                    t.next_start = now + attempt_delay;
+                }
+                else
+                {
+                    results[i].error = strerror(errno);
+                    close(fd);
+                }
+            }
+            if(!t.done && t.in_flight == 0 && t.next == t.addrs.size())
+                t.done = true; // every address failed
+            if(!t.done && t.next < t.addrs.size())
+                wake = std::min(wake, t.next_start);
+        }
+
+        // drop the attempts of the endpoints already connected
+        for(size_t k = 0; k < attempts.size();)
+            if(targets[attempts[k].target].done)
+            {
+                close(attempts[k].fd);
+                attempts[k] = attempts.back();
+                attempts.pop_back();
+            }
+            else
+                k++;
+        if(attempts.empty() && std::all_of(targets.begin(), targets.end(),
+                                           [](const Target &t)
+                                           { return t.done; }))
+            break;
+        if(now >= deadline)
+            break;
+
+        std::vector<struct pollfd> fds(attempts.size());
+        for(size_t k = 0; k < attempts.size(); k++)
+            fds[k] = {attempts[k].fd, POLLOUT, 0};
+        int wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          wake - now)
+                          .count() +
+                      1;
+        if(poll(fds.data(), fds.size(), wait_ms) < 0 && errno != EINTR)
+            break;
+
+        now = Clock::now();
+        std::vector<Attempt> still;
+        for(size_t k = 0; k < attempts.size(); k++)
+        {
+            size_t i = attempts[k].target;
+            if(!fds[k].revents || targets[i].done)
+            {
+                still.push_back(attempts[k]);
+                continue;
+            }
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fds[k].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            targets[i].in_flight--;
+            if(err == 0)
+                connected(i, fds[k].fd);
+            else
+            {
+                // try the next address right away
+                results[i].error = strerror(err);
+                targets[i].next_start = now;
+                close(fds[k].fd);
+            }
+        }
+        attempts.swap(still);
+    }
+
+    for(Attempt &a : attempts) close(a.fd);
+    for(size_t i = 0; i < targets.size(); i++)
+        if(!targets[i].done)
+            results[i].error = "Connection timed out";
+#else
+    // no poll(), connect one endpoint after the other
+    for(size_t i = 0; i < endpoints.size(); i++)
+    {
+        TCP *client = new TCP(verbose);
+        try
+        {
+            client->open_connection(endpoints[i].address.c_str(),
+                                    endpoints[i].port,
+                                    std::max(timeout_ms / 1000, 1));
+            results[i].client.reset(client);
+        }
+        catch(const std::exception &e)
+        {
+            results[i].error = e.what();
+            delete client;
+        }
+    }
+#endif
+    return results;
+}
+
 int
 TCP::readS(uint8_t *buffer, size_t size, bool has_crc, bool read_until)
 {
-    std::lock_guard<std::mutex> lck(*m_mutex); //ensure only one thread using it
+    std::lock_guard<std::mutex> lck(m_rx_mutex); //ensure only one thread using it
     if(m_is_connected)
     {
+        if(m_rx_buffer)
+            return read_buffered(buffer, size, has_crc, read_until);
+
+        // the CRC is accumulated as the chunks arrive (see update_CRC)
+        CRCAccumulator crc(m_crc);
 #if defined(__linux__) || defined(__APPLE__)
         ssize_t n = recv(m_fd, buffer, size, 0);
+        m_rx_syscalls++;
+        rearm_quickack();
+        if(has_crc && n > 0)
+            update_CRC(crc, buffer, size, n);
         if((size_t)n != size && read_until)
-            while((size_t)n != size) n += recv(m_fd, buffer + n, size - n, 0);
+            while((size_t)n != size)
+            {
+                n += recv(m_fd, buffer + n, size - n, 0);
+                m_rx_syscalls++;
+                rearm_quickack();
+                if(has_crc && n > 0)
+                    update_CRC(crc, buffer, size, n);
+            }
 #elif _WIN32
         DWORD n = 0;
         if(!ReadFile((HANDLE)m_fd, buffer, size, &n, NULL))
@@ -130,7 +373,7 @@ TCP::readS(uint8_t *buffer, size_t size, bool has_crc, bool read_until)
             }
 #endif
         if(has_crc)
-            return check_CRC(buffer, size) ? n : -1;
+            return finish_CRC(crc, buffer, size) ? n : -1;
         return n;
     }
     return -1;
@@ -139,20 +382,699 @@ TCP::readS(uint8_t *buffer, size_t size, bool has_crc, bool read_until)
 int
 TCP::writeS(const void *buffer, size_t size, bool add_crc)
 {
-    std::lock_guard<std::mutex> lck(*m_mutex); //ensure only one thread using it
+    std::lock_guard<std::mutex> lck(m_tx_mutex); //ensure only one thread using it
     if(!m_is_connected)
         return -1;
 
     if(add_crc)
-        *(uint16_t *)((uint8_t *)buffer + size) = CRC((uint8_t *)buffer, size);
+        append_CRC((uint8_t *)buffer, size);
 
+    int64_t start_ns = m_tx_stamps ? Timestamping::now_ns() : 0;
+    int n;
+    if(m_tx_budget_us >= 0)
+    {
+        if(!m_tx)
+            m_tx.reset(new Coalescer(m_fd, m_tx_budget_us, m_tx_threshold));
+        n = m_tx->write(buffer, size + 2 * add_crc);
+    }
+    else
+    {
 #if defined(__linux__) || defined(__APPLE__)
-    return send(m_fd, buffer, size + 2 * add_crc, 0);
+        m_tx_syscalls++;
+        n = send(m_fd, buffer, size + 2 * add_crc, 0);
 #elif _WIN32
-    DWORD n = 0;
-    if(WriteFile((HANDLE)m_fd, buffer, size + 2 * add_crc, &n, NULL))
-        return n;
-    return -1;
+        DWORD written = 0;
+        n = WriteFile((HANDLE)m_fd, buffer, size + 2 * add_crc, &written, NULL)
+                ? (int)written
+                : -1;
+#endif
+    }
+    if(m_tx_stamps && n > 0)
+        m_tx_stamps->on_send(n, start_ns);
+    return n;
+}
+
+int
+TCP::write_zerocopy(const void *buffer, size_t size, uint64_t *id, bool add_crc)
+{
+    std::lock_guard<std::mutex> lck(m_tx_mutex); //ensure only one thread using it
+    if(id)
+        *id = 0;
+    if(!m_is_connected)
+        return -1;
+
+    if(add_crc)
+        append_CRC((uint8_t *)buffer, size);
+    if(m_tx)
+        m_tx->flush(); // keep the order of the messages
+    if(!m_zc)
+    {
+        m_zc = std::make_shared<ZeroCopy>(m_fd, m_zc_threshold, error_queue());
+        if(!m_zc->enabled())
+            logln("SO_ZEROCOPY not supported, buffers will be copied", true);
+    }
+    int64_t start_ns = m_tx_stamps ? Timestamping::now_ns() : 0;
+    int n = m_zc->send(buffer, size + 2 * add_crc, id);
+    if(m_tx_stamps && n > 0)
+        m_tx_stamps->on_send(n, start_ns);
+    return n;
+}
+
+void
+TCPServer::update_events(Connection &c)
+{
+#ifdef __linux__
+    if(!c.open)
+        return;
+    if(m_uring)
+    {
+        if(c.paused)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(m_uring_mutex);
+            m_uring_resumed.push_back(c.socket);
+        }
+        uint64_t one = 1;
+        if(write(m_wake_fd, &one, sizeof(one)) < 0)
+            logln("Could not wake the io_uring thread", true);
+        return;
+    }
+    if(c.epoll_fd < 0)
+        return;
+    // level-triggered EPOLLRDHUP would fire again and again while paused
+    struct epoll_event ev = {};
+    if(!c.paused)
+        ev.events = EPOLLIN | EPOLLRDHUP;
+    if(c.tx_armed)
+        ev.events |= EPOLLOUT;
+    ev.data.fd = c.socket;
+    epoll_ctl(c.epoll_fd, EPOLL_CTL_MOD, c.socket, &ev);
+#else
+    (void)c;
+#endif
+}
+
+void
+TCPServer::drain(const std::shared_ptr<Connection> &c, bool complete)
+{
+    bool handoff = false;
+    {
+        std::lock_guard<std::mutex> lock(c->mutex);
+        if(!c->open)
+            c->txq.clear();
+        // on error the receive side sees the closed socket
+        else if(c->txq.drain(c->socket) >= 0 && !c->txq.empty())
+        {
+#ifdef __linux__
+            if(c->epoll_fd >= 0)
+            {
+                if(!c->tx_armed)
+                {
+                    c->tx_armed = true;
+                    update_events(*c);
+                }
+            }
+            else
+#endif
+                handoff = true;
+        }
+    }
+    if(handoff)
+    {
+        std::lock_guard<std::mutex> lock(m_tx_mutex);
+        if(!c->tx_pending)
+        {
+            c->tx_pending = true;
+            m_tx_pending.push_back(c);
+        }
+        if(!m_tx_thread.joinable())
+            m_tx_thread = std::thread(&TCPServer::writer_loop, this);
+        m_tx_cv.notify_all();
+    }
+    if(complete)
+        c->txq.complete();
+}
+
+void
+TCPServer::writer_loop()
+{
+#if defined(__linux__) || defined(__APPLE__)
+    std::vector<std::shared_ptr<Connection>> pending;
+    std::vector<struct pollfd> fds;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_tx_mutex);
+            m_tx_cv.wait(lock,
+                         [&]() { return m_tx_stop || !m_tx_pending.empty(); });
+            if(m_tx_stop)
+                return;
+            pending = m_tx_pending;
+        }
+        fds.clear();
+        for(std::shared_ptr<Connection> &c : pending)
+            fds.push_back({c->socket, POLLOUT, 0});
+        // short timeout: the clients queued meanwhile are picked up next turn
+        if(poll(fds.data(), fds.size(), 10) > 0)
+            for(size_t i = 0; i < fds.size(); i++)
+            {
+                if(!fds[i].revents)
+                    continue;
+                std::shared_ptr<Connection> &c = pending[i];
+                {
+                    std::lock_guard<std::mutex> lock(c->mutex);
+                    if(!c->open || c->txq.drain(c->socket) < 0)
+                        c->txq.clear();
+                }
+                c->txq.complete();
+            }
+
+        std::lock_guard<std::mutex> lock(m_tx_mutex);
+        for(size_t i = 0; i < m_tx_pending.size();)
+        {
+            std::shared_ptr<Connection> &c = m_tx_pending[i];
+            if(c->txq.empty() || !c->open)
+            {
+                c->tx_pending = false;
+                c = std::move(m_tx_pending.back());
+                m_tx_pending.pop_back();
+            }
+            else
+                i++;
+        }
+    }
+#endif
+}
+
+bool
+TCPServer::start_reactor()
+{
+#ifdef __linux__
+    m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_wake_fd < 0)
+        throw log_error("eventfd() failed [" + std::string(strerror(errno)) +
+                        "]");
+
+    // sharded mode: one SO_REUSEPORT listening socket per I/O thread
+    if(m_n_shards > 0)
+    {
+        m_shard_accepts.reset(new std::atomic<uint64_t>[m_n_io_threads]());
+        m_shard_fds.push_back(m_fd);
+        for(int i = 1; i < m_n_io_threads; i++)
+            m_shard_fds.push_back(open_shard());
+    }
+
+    for(int i = 0; i < m_n_io_threads; i++)
+    {
+        SOCKET listen_fd = m_n_shards > 0 ? m_shard_fds[i] : m_fd;
+        int flags = fcntl(listen_fd, F_GETFL, 0);
+        fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK);
+
+        int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if(epoll_fd < 0)
+            throw log_error("epoll_create1() failed [" +
+                            std::string(strerror(errno)) + "]");
+        m_epoll_fds.push_back(epoll_fd);
+
+        // without shards every reactor waits on the listening socket,
+        // EPOLLEXCLUSIVE wakes only one of them per incoming connection
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        if(m_n_shards == 0)
+            ev.events |= EPOLLEXCLUSIVE;
+        ev.data.fd = listen_fd;
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+            throw log_error("epoll_ctl() failed on listening socket [" +
+                            std::string(strerror(errno)) + "]");
+
+        ev.events = EPOLLIN;
+        ev.data.fd = m_wake_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &ev);
+    }
+
+    for(int i = 0; i < m_n_io_threads; i++)
+        m_io_threads.emplace_back(
+            &TCPServer::reactor_loop, this, m_epoll_fds[i],
+            m_n_shards > 0 ? m_shard_fds[i] : m_fd, m_n_shards > 0 ? i : -1);
+    logln("Reactor started with " + std::to_string(m_n_io_threads) +
+              " epoll thread(s)" + (m_n_shards > 0 ? " and shards" : ""),
+          true);
+    return true;
+#else
+    logln("Reactor engine not available on this platform, using threads",
+          true);
+    return false;
+#endif
+}
+
+SOCKET
+TCPServer::open_shard()
+{
+#ifdef __linux__
+    // same port as the first listening socket, even if it was 0
+    SOCKADDR_IN sin;
+    socklen_t len = sizeof(sin);
+    getsockname(m_fd, (SOCKADDR *)&sin, &len);
+
+    SOCKET fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd == INVALID_SOCKET)
+        throw log_error("socket() invalid");
+    int one = 1;
+    int nodelay = m_nagled ? 1 : 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    m_profile.apply(fd);
+    if(bind(fd, (SOCKADDR *)&sin, sizeof(sin)) == SOCKET_ERROR ||
+       listen(fd, m_max_connections) == SOCKET_ERROR)
+    {
+        std::string error = strerror(errno);
+        closesocket(fd);
+        throw log_error("Failed to open a shard on port " +
+                        std::to_string(ntohs(sin.sin_port)) + " [" + error +
+                        "]");
+    }
+    return fd;
+#else
+    return INVALID_SOCKET;
+#endif
+}
+
+/**
+ * @brief Pin the calling thread to the n-th CPU it is allowed to run on
+ * (modulo their number).
+ */
+static void
+pin_thread(int n)
+{
+#ifdef __linux__
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+    int n_cpus = CPU_COUNT(&allowed);
+    if(n_cpus == 0)
+        return;
+    n %= n_cpus;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if(CPU_ISSET(cpu, &allowed) && n-- == 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            return;
+        }
+#else
+    (void)n;
+#endif
+}
+
+void
+TCPServer::stop_engine()
+{
+#ifdef __linux__
+    if(m_wake_fd < 0)
+        return;
+    uint64_t one = 1;
+    if(write(m_wake_fd, &one, sizeof(one)) < 0)
+        logln("Could not wake the I/O threads", true);
+    logln("Waiting for I/O threads to join", true);
+    for(auto &thread : m_io_threads)
+        if(thread.joinable())
+            thread.join();
+    m_io_threads.clear();
+
+    // the engine owns the client sockets, close the remaining ones
+    for(SOCKET s : m_connections.snapshot()) remove_client(s);
+
+    for(int epoll_fd : m_epoll_fds) close(epoll_fd);
+    m_epoll_fds.clear();
+    // the first shard is m_fd, closed by Server::stop()
+    for(size_t i = 1; i < m_shard_fds.size(); i++) closesocket(m_shard_fds[i]);
+    m_shard_fds.clear();
+    m_uring.reset();
+    close(m_wake_fd);
+    m_wake_fd = -1;
+#endif
+}
+
+void
+TCPServer::reactor_loop(int epoll_fd, SOCKET listen_fd, int shard)
+{
+#ifdef __linux__
+    if(shard >= 0 && m_pin_shards)
+        pin_thread(shard);
+    const int max_events = 64;
+    struct epoll_event events[max_events];
+    uint8_t buffer[16384];
+
+    while(m_is_running)
+    {
+        int n = epoll_wait(epoll_fd, events, max_events, -1);
+        m_rx_syscalls++;
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            std::cerr << "epoll_wait() failed: " << strerror(errno)
+                      << std::endl;
+            break;
+        }
+
+        for(int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if(fd == m_wake_fd)
+                continue; // stop requested, m_is_running is false
+            if(fd == listen_fd)
+            {
+                // accept every pending connection
+                while(true)
+                {
+                    SOCKADDR_IN client_addr;
+                    socklen_t client_addr_len = sizeof(client_addr);
+                    SOCKET client_socket = accept4(
+                        listen_fd, reinterpret_cast<SOCKADDR *>(&client_addr),
+                        &client_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if(client_socket == INVALID_SOCKET)
+                    {
+                        if(errno != EWOULDBLOCK && errno != EAGAIN &&
+                           errno != EINTR)
+                            std::cerr << "accept() failed: " << strerror(errno)
+                                      << std::endl;
+                        break;
+                    }
+                    add_client(client_socket, client_addr);
+                    if(shard >= 0)
+                        m_shard_accepts[shard]++;
+
+                    struct epoll_event ev = {};
+                    ev.events = EPOLLIN | EPOLLRDHUP;
+                    ev.data.fd = client_socket;
+                    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) <
+                       0)
+                    {
+                        std::cerr << "epoll_ctl() failed: " << strerror(errno)
+                                  << std::endl;
+                        remove_client(client_socket);
+                        continue;
+                    }
+                    // from now on this thread sends the backlog of the client
+                    std::shared_ptr<Connection> c =
+                        get_connection(client_socket);
+                    if(c)
+                    {
+                        std::lock_guard<std::mutex> lock(c->mutex);
+                        c->epoll_fd = epoll_fd;
+                        update_events(*c); // paused or backlogged already
+                    }
+                }
+                continue;
+            }
+
+            if(events[i].events & EPOLLOUT)
+            {
+                std::shared_ptr<Connection> c = get_connection(fd);
+                if(c)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(c->mutex);
+                        if(c->open && (c->txq.drain(fd) < 0 || c->txq.empty()))
+                        {
+                            c->tx_armed = false;
+                            update_events(*c);
+                        }
+                    }
+                    c->txq.complete();
+                }
+                if(!(events[i].events & ~EPOLLOUT))
+                    continue;
+            }
+
+            // drain the client socket, then close it if the peer hung up
+            bool closed = false;
+            while(true)
+            {
+                RxTimestamp ts;
+                ssize_t bytes_received =
+                    m_timestamping
+                        ? Timestamping::recv(fd, buffer, sizeof(buffer), 0, ts)
+                        : recv(fd, buffer, sizeof(buffer), 0);
+                m_rx_syscalls++;
+                if(bytes_received > 0)
+                {
+                    // paused: EPOLLIN comes back under the low watermark
+                    if(!on_receive(fd, buffer, bytes_received, ts) ||
+                       (size_t)bytes_received < sizeof(buffer))
+                        break;
+                }
+                else if(bytes_received == 0)
+                {
+                    logln("Client disconnected.", true);
+                    closed = true;
+                    break;
+                }
+                else
+                {
+                    if(errno == EINTR)
+                        continue;
+                    if(errno != EWOULDBLOCK && errno != EAGAIN)
+                    {
+                        std::cerr << "Error receiving data: " << strerror(errno)
+                                  << std::endl;
+                        closed = true;
+                    }
+                    break;
+                }
+            }
+            if(!closed && (events[i].events & EPOLLERR))
+            {
+                // zero-copy completions are signalled as errors too: read
+                // them and only close on a real socket error
+                std::shared_ptr<Connection> c = get_connection(fd);
+                if(c && c->zc)
+                    c->zc->poll();
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                closed = !c || !c->zc || err != 0;
+            }
+            if(!closed && (events[i].events & EPOLLHUP))
+                closed = true;
+            if(closed)
+            {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                remove_client(fd);
+            }
+        }
+    }
+#else
+    (void)epoll_fd;
+    (void)listen_fd;
+    (void)shard;
+#endif
+}
+
+#ifdef __linux__
+// io_uring user_data: request kind in the high word, socket in the low word
+enum
+{
+    URING_ACCEPT = 1,
+    URING_RECV = 2,
+    URING_WAKE = 3,
+    URING_CANCEL = 4
+};
+static uint64_t
+uring_data(uint32_t kind, int fd)
+{
+    return ((uint64_t)kind << 32) | (uint32_t)fd;
+}
+#endif
+
+bool
+TCPServer::start_uring()
+{
+#ifdef __linux__
+    if(!URing::supported())
+    {
+        logln("io_uring not supported by the kernel, using threads", true);
+        return false;
+    }
+    m_uring.reset(new URing());
+    if(!m_uring->init(1024) ||
+       !m_uring->setup_buffer_ring(0, 256, 16384))
+    {
+        m_uring.reset();
+        logln("Could not setup io_uring, using threads", true);
+        return false;
+    }
+    m_wake_fd = eventfd(0, EFD_CLOEXEC);
+    if(m_wake_fd < 0)
+        throw log_error("eventfd() failed [" + std::string(strerror(errno)) +
+                        "]");
+    m_io_threads.emplace_back(&TCPServer::uring_loop, this);
+    logln("io_uring engine started", true);
+    return true;
+#else
+    logln("io_uring engine not available on this platform, using threads",
+          true);
+    return false;
+#endif
+}
+
+void
+TCPServer::uring_loop()
+{
+#ifdef __linux__
+    URing &ring = *m_uring;
+    uint64_t wake_value;
+    // a lost accept or wake request would leave the loop deaf: stop instead
+    bool lost =
+        !ring.prep_multishot_accept(m_fd, uring_data(URING_ACCEPT, m_fd)) ||
+        !ring.prep_read(m_wake_fd, &wake_value, sizeof(wake_value),
+                        uring_data(URING_WAKE, m_wake_fd));
+    // receive from a client unless it is paused or already receiving
+    auto arm = [&](Connection &c)
+    {
+        if(c.uring_recv)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(c.mutex);
+            if(c.paused || !c.open)
+                return;
+        }
+        if(!ring.prep_multishot_recv(c.socket, 0,
+                                     uring_data(URING_RECV, c.socket)))
+        {
+            // the client would never be read again
+            std::cerr << "io_uring submission queue full, dropping client"
+                      << std::endl;
+            remove_client(c.socket);
+            return;
+        }
+        c.uring_recv = true;
+    };
+
+    while(m_is_running && !lost)
+    {
+        int ret = ring.submit(1);
+        m_rx_syscalls++;
+        if(ret < 0 && ret != -EINTR && ret != -EBUSY)
+        {
+            std::cerr << "io_uring_enter() failed: " << strerror(-ret)
+                      << std::endl;
+            break;
+        }
+
+        ring.drain(
+            [&](struct io_uring_cqe *cqe)
+            {
+                int fd = (int)(uint32_t)cqe->user_data;
+                bool more = cqe->flags & IORING_CQE_F_MORE;
+                switch(cqe->user_data >> 32)
+                {
+                case URING_ACCEPT:
+                    if(cqe->res >= 0)
+                    {
+                        SOCKET client_socket = cqe->res;
+                        SOCKADDR_IN client_addr;
+                        socklen_t client_addr_len = sizeof(client_addr);
+                        memset(&client_addr, 0, sizeof(client_addr));
+                        getpeername(client_socket, (SOCKADDR *)&client_addr,
+                                    &client_addr_len);
+                        add_client(client_socket, client_addr);
+                        std::shared_ptr<Connection> c =
+                            get_connection(client_socket);
+                        if(c)
+                            arm(*c);
+                    }
+                    else if(cqe->res != -EAGAIN && cqe->res != -EINTR)
+                        std::cerr << "accept() failed: " << strerror(-cqe->res)
+                                  << std::endl;
+                    if(!more && m_is_running &&
+                       !ring.prep_multishot_accept(
+                           m_fd, uring_data(URING_ACCEPT, m_fd)))
+                        lost = true;
+                    break;
+                case URING_RECV:
+                {
+                    std::shared_ptr<Connection> c = get_connection(fd);
+                    if(cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+                    {
+                        uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                        // a multishot recv has no control data, only the
+                        // time of the completion is known
+                        RxTimestamp ts;
+                        if(m_timestamping)
+                            ts.user_ns = Timestamping::now_ns();
+                        // paused: stop the receive, the completions already
+                        // queued are still stored. The cancel is submitted
+                        // before any buffer is recycled, else the kernel
+                        // fills the recycled buffers until the drain ends.
+                        // (no room for the cancel: try again on the next one)
+                        if(!on_receive(fd, ring.buffer(bid), cqe->res, ts) &&
+                           more && c && !c->uring_cancel)
+                        {
+                            c->uring_cancel =
+                                ring.prep_cancel(uring_data(URING_RECV, fd),
+                                                 uring_data(URING_CANCEL, fd));
+                            if(c->uring_cancel)
+                                ring.submit(0);
+                        }
+                        ring.recycle(bid);
+                    }
+                    if(more)
+                        break;
+                    if(c)
+                        c->uring_recv = c->uring_cancel = false;
+                    // the multishot request ended: out of buffers, cancelled
+                    // (paused, armed again on resume), or closed
+                    if(cqe->res > 0 || cqe->res == -ENOBUFS ||
+                       cqe->res == -ECANCELED)
+                    {
+                        if(c)
+                            arm(*c);
+                    }
+                    else
+                    {
+                        if(cqe->res < 0)
+                            std::cerr << "Error receiving data: "
+                                      << strerror(-cqe->res) << std::endl;
+                        else
+                            logln("Client disconnected.", true);
+                        remove_client(fd);
+                    }
+                    break;
+                }
+                case URING_WAKE: // stop requested, or clients resumed
+                {
+                    if(!m_is_running)
+                        break;
+                    std::vector<SOCKET> resumed;
+                    {
+                        std::lock_guard<std::mutex> lock(m_uring_mutex);
+                        resumed.swap(m_uring_resumed);
+                    }
+                    for(SOCKET s : resumed)
+                    {
+                        std::shared_ptr<Connection> c = get_connection(s);
+                        if(c)
+                            arm(*c);
+                    }
+                    if(!ring.prep_read(m_wake_fd, &wake_value,
+                                       sizeof(wake_value),
+                                       uring_data(URING_WAKE, m_wake_fd)))
+                        lost = true;
+                    break;
+                }
+                case URING_CANCEL: // the receive ends with -ECANCELED
+                    break;
+                }
+            });
+    }
+    if(lost)
+        std::cerr << "io_uring submission queue full, server loop stopped"
+                  << std::endl;
 #endif
 }
 
@@ -0,0 +1,224 @@
+#include "timestamping.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <errno.h>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netinet/in.h>
+#include <time.h>
+#elif defined(_WIN32)
+#include <winsock2.h>
+#endif
+
+namespace Communication
+{
+
+void
+LatencyStats::add(int64_t ns)
+{
+    min_ns = count ? std::min(min_ns, ns) : ns;
+    max_ns = count ? std::max(max_ns, ns) : ns;
+    sum_ns += ns;
+    count++;
+}
+
+std::string
+LatencyStats::to_string() const
+{
+    return "n=" + std::to_string(count) +
+           " min=" + std::to_string(min_ns / 1000) +
+           "us mean=" + std::to_string((int64_t)mean_ns() / 1000) +
+           "us max=" + std::to_string(max_ns / 1000) + "us";
+}
+
+namespace Timestamping
+{
+
+int64_t
+now_ns()
+{
+#ifdef __linux__
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+bool
+enable_rx(int fd)
+{
+#ifdef __linux__
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+                      sizeof(flags)) == 0;
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+size_t
+control_size()
+{
+#ifdef __linux__
+    return CMSG_SPACE(sizeof(struct scm_timestamping));
+#else
+    return 0;
+#endif
+}
+
+#ifdef __linux__
+/**
+ * @brief Software timestamp of an SCM_TIMESTAMPING message, 0 if it is not
+ * one.
+ */
+static int64_t
+software_timestamp(const struct cmsghdr *cm)
+{
+    if(cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_TIMESTAMPING)
+        return 0;
+    struct scm_timestamping tss;
+    memcpy(&tss, CMSG_DATA(cm), sizeof(tss));
+    return (int64_t)tss.ts[0].tv_sec * 1000000000 + tss.ts[0].tv_nsec;
+}
+#endif
+
+int64_t
+rx_timestamp(const void *control, size_t size)
+{
+#ifdef __linux__
+    struct msghdr msg = {};
+    msg.msg_control = (void *)control;
+    msg.msg_controllen = size;
+    for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+        cm = CMSG_NXTHDR(&msg, cm))
+    {
+        int64_t ns = software_timestamp(cm);
+        if(ns)
+            return ns;
+    }
+#else
+    (void)control;
+    (void)size;
+#endif
+    return 0;
+}
+
+long
+recv(int fd,
+     void *buffer,
+     size_t size,
+     int flags,
+     RxTimestamp &ts,
+     struct sockaddr *from,
+     socklen_t *from_size)
+{
+#ifdef __linux__
+    char control[64];
+    struct iovec iov = {buffer, size};
+    struct msghdr msg = {};
+    msg.msg_name = from;
+    msg.msg_namelen = from_size ? *from_size : 0;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(fd, &msg, flags);
+    ts.user_ns = now_ns();
+    ts.kernel_ns = n > 0 ? rx_timestamp(control, msg.msg_controllen) : 0;
+    if(from_size)
+        *from_size = msg.msg_namelen;
+    return n;
+#else
+    ts = RxTimestamp();
+    long n = from ? ::recvfrom(fd, (char *)buffer, size, flags, from, from_size)
+                  : ::recv(fd, (char *)buffer, size, flags);
+    ts.user_ns = now_ns();
+    return n;
+#endif
+}
+
+} // namespace Timestamping
+
+bool
+TxTimestamps::attach(int fd, std::shared_ptr<ErrorQueue> errors)
+{
+    m_errors = errors ? std::move(errors) : std::make_shared<ErrorQueue>(fd);
+    m_errors->want_timestamps();
+    m_units = 0;
+    m_writes.clear();
+#ifdef __linux__
+    int type = 0;
+    socklen_t len = sizeof(type);
+    getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len);
+    m_stream = type == SOCK_STREAM;
+    int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    if(m_stream)
+        flags |= SOF_TIMESTAMPING_TX_ACK;
+    return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+                      sizeof(flags)) == 0;
+#else
+    return false;
+#endif
+}
+
+void
+TxTimestamps::on_send(size_t size, int64_t user_ns)
+{
+    if(size == 0)
+        return;
+    m_units += m_stream ? size : 1;
+    m_writes[m_units - 1] = {user_ns, false};
+    // the reports of an unread error queue are dropped by the kernel
+    if(m_writes.size() > 1024)
+        read();
+    while(m_writes.size() > 1024) m_writes.erase(m_writes.begin());
+}
+
+void
+TxTimestamps::read()
+{
+    if(!m_errors)
+        return;
+    for(const ErrorQueue::Timestamp &ts : m_errors->take_timestamps())
+        on_timestamp(ts.kind, ts.id, ts.ns);
+}
+
+void
+TxTimestamps::on_timestamp(uint32_t kind, uint32_t id, int64_t ns)
+{
+#ifdef __linux__
+    // the kernel ids are the 32 low bits of ours, a report covers every
+    // write up to it
+    for(auto it = m_writes.begin();
+        it != m_writes.end() && (int32_t)(id - (uint32_t)it->first) >= 0;)
+    {
+        Write &write = it->second;
+        if(kind == SCM_TSTAMP_SND && !write.sent)
+        {
+            m_send.add(ns - write.user_ns);
+            write.sent = true;
+        }
+        else if(kind == SCM_TSTAMP_ACK)
+            m_ack.add(ns - write.user_ns);
+        // the last report of a write: the ACK on TCP, the send on UDP
+        bool done = kind == SCM_TSTAMP_ACK || !m_stream;
+        it = done ? m_writes.erase(it) : std::next(it);
+    }
+#else
+    (void)kind;
+    (void)id;
+    (void)ns;
+#endif
+}
+
+} // namespace Communication
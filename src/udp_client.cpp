@@ -1,5 +1,9 @@
 #include "udp_client.hpp"
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
 namespace Communication
 {
 
@@ -12,23 +16,27 @@ UDP::open_connection(const char *address, int port, int timeout)
 {
     (void)timeout;
 #ifdef __linux__
-    struct hostent *hostinfo;
     cli_id() += ((cli_id() == "") ? "" : " - ") +
                 fstr_link(std::string(address) + ":" + std::to_string(port));
 
     m_fd = socket(AF_INET, SOCK_DGRAM, 0);
     if(m_fd == INVALID_SOCKET)
         throw log_error("socket() invalid");
+    m_profile.apply(m_fd);
 
-    hostinfo = gethostbyname(address);
-    if(hostinfo == NULL)
-        throw log_error(std::string("Unknown host") + address);
-
-    m_addr_to.sin_addr = *(IN_ADDR *)hostinfo->h_addr;
-    m_addr_to.sin_port = htons(port);
-    m_addr_to.sin_family = AF_INET;
+    // IPv4 only, m_addr_to is a sockaddr_in
+    Resolution resolution = Resolver::instance().resolve(address, SOCK_DGRAM);
+    std::vector<sockaddr_storage> addrs = resolution.with_port(port, AF_INET);
+    if(addrs.empty())
+        throw log_error(std::string("Unknown host ") + address + " [" +
+                        (resolution.error.empty() ? "no IPv4 address"
+                                                  : resolution.error) +
+                        "]");
+    memcpy(&m_addr_to, &addrs[0], sizeof(m_addr_to));
 
     m_size_addr = sizeof(m_addr_to);
+    if(m_tx_stamps && !m_tx_stamps->attach(m_fd, error_queue()))
+        logln("TX timestamping not supported", true);
 
     logln("UDP socket is setup. ", true);
 #endif
@@ -38,14 +46,22 @@ UDP::open_connection(const char *address, int port, int timeout)
 int
 UDP::readS(uint8_t *buffer, size_t size, bool has_crc, bool read_until)
 {
-    std::lock_guard<std::mutex> lck(*m_mutex); //ensure only one thread using it
+    std::lock_guard<std::mutex> lck(m_rx_mutex); //ensure only one thread using it
 #ifdef __linux__
-    ssize_t n = recvfrom(m_fd, buffer, size, MSG_WAITALL, (SOCKADDR *)&m_addr_to,
-                     &m_size_addr);
+    // replies go to the last sender, m_addr_to belongs to the write side
+    SOCKADDR_IN from;
+    socklen_t from_size = sizeof(from);
+    ssize_t n = recvfrom(m_fd, buffer, size, MSG_WAITALL, (SOCKADDR *)&from,
+                         &from_size);
     if((size_t)n != size && read_until)
         while((size_t)n != size)
             n += recvfrom(m_fd, buffer + n, size - n, MSG_WAITALL,
-                          (SOCKADDR *)&m_addr_to, &m_size_addr);
+                          (SOCKADDR *)&from, &from_size);
+    {
+        std::lock_guard<std::mutex> tx_lck(m_tx_mutex);
+        m_addr_to = from;
+        m_size_addr = from_size;
+    }
 
     if(has_crc)
         return check_CRC(buffer, size) ? n : -1;
@@ -57,13 +73,177 @@ UDP::readS(uint8_t *buffer, size_t size, bool has_crc, bool read_until)
 int
 UDP::writeS(const void *buffer, size_t size, bool add_crc)
 {
-    std::lock_guard<std::mutex> lck(*m_mutex); //ensure only one thread using it
+    std::lock_guard<std::mutex> lck(m_tx_mutex); //ensure only one thread using it
+    if(add_crc)
+        append_CRC((uint8_t *)buffer, size);
 #ifdef __linux__
-    return sendto(m_fd, buffer, size + 2 * add_crc, 0, (SOCKADDR *)&m_addr_to,
-                  m_size_addr);
+    int64_t start_ns = m_tx_stamps ? Timestamping::now_ns() : 0;
+    int n = sendto(m_fd, buffer, size + 2 * add_crc, 0,
+                   (SOCKADDR *)&m_addr_to, m_size_addr);
+    if(m_tx_stamps && n > 0)
+        m_tx_stamps->on_send(n, start_ns);
+    return n;
 #endif
     return -1;
 }
 
+int
+UDP::writevS(const struct iovec *segments, int n_segments, bool add_crc)
+{
+#ifdef __linux__
+    uint8_t trailer[2];
+    std::vector<struct iovec> iov;
+    CRC_segments(segments, n_segments, add_crc, trailer, iov);
+    std::lock_guard<std::mutex> lck(m_tx_mutex); //ensure only one thread using it
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &m_addr_to;
+    msg.msg_namelen = m_size_addr;
+    msg.msg_iov = iov.data();
+    msg.msg_iovlen = iov.size();
+    int64_t start_ns = m_tx_stamps ? Timestamping::now_ns() : 0;
+    int n = sendmsg(m_fd, &msg, 0);
+    if(m_tx_stamps && n > 0)
+        m_tx_stamps->on_send(n, start_ns);
+    return n;
+#else
+    return Client::writevS(segments, n_segments, add_crc);
+#endif
+}
+
+bool
+UDPServer::start_uring()
+{
+#ifdef __linux__
+    if(!URing::supported())
+    {
+        logln("io_uring not supported by the kernel, using threads", true);
+        return false;
+    }
+    m_uring.reset(new URing());
+    if(!m_uring->init(256) || !m_uring->setup_buffer_ring(0, 256, 2048))
+    {
+        m_uring.reset();
+        logln("Could not setup io_uring, using threads", true);
+        return false;
+    }
+    m_wake_fd = eventfd(0, EFD_CLOEXEC);
+    if(m_wake_fd < 0)
+    {
+        m_uring.reset();
+        throw log_error("eventfd() failed [" + std::string(strerror(errno)) +
+                        "]");
+    }
+    logln("io_uring engine started", true);
+    return true;
+#else
+    logln("io_uring engine not available on this platform, using threads",
+          true);
+    return false;
+#endif
+}
+
+void
+UDPServer::wake_uring()
+{
+#ifdef __linux__
+    if(m_wake_fd < 0)
+        return;
+    uint64_t one = 1;
+    if(write(m_wake_fd, &one, sizeof(one)) < 0)
+        logln("Could not wake the receive thread", true);
+#endif
+}
+
+void
+UDPServer::uring_loop()
+{
+#ifdef __linux__
+    // user_data of the two requests in flight
+    const uint64_t recv_data = 1, wake_data = 2;
+    URing &ring = *m_uring;
+    uint64_t wake_value;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_namelen = sizeof(SOCKADDR_IN);
+    if(m_timestamping) // room for the timestamp in the buffers
+        msg.msg_controllen = Timestamping::control_size();
+
+    // a lost receive or wake request would leave the loop deaf: stop instead
+    bool lost = !ring.prep_multishot_recvmsg(m_fd, &msg, 0, recv_data) ||
+                !ring.prep_read(m_wake_fd, &wake_value, sizeof(wake_value),
+                                wake_data);
+
+    while(m_is_running && !lost)
+    {
+        int ret = ring.submit(1);
+        m_rx_syscalls++;
+        if(ret < 0 && ret != -EINTR && ret != -EBUSY)
+        {
+            std::cerr << "io_uring_enter() failed: " << strerror(-ret)
+                      << std::endl;
+            break;
+        }
+
+        ring.drain(
+            [&](struct io_uring_cqe *cqe)
+            {
+                if(cqe->user_data != recv_data)
+                    return; // stop requested, m_is_running is false
+
+                if(cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+                {
+                    // buffer layout: header, source address, payload
+                    uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                    uint8_t *buffer = ring.buffer(bid);
+                    struct io_uring_recvmsg_out out;
+                    memcpy(&out, buffer, sizeof(out));
+                    size_t offset = sizeof(out) + msg.msg_namelen +
+                                    msg.msg_controllen;
+                    size_t size =
+                        std::min<size_t>(out.payloadlen,
+                                         ring.buffer_size() - offset - 1);
+
+                    SOCKADDR_IN client_addr;
+                    memset(&client_addr, 0, sizeof(client_addr));
+                    memcpy(&client_addr, buffer + sizeof(out),
+                           std::min<size_t>(out.namelen, sizeof(client_addr)));
+                    RxTimestamp ts;
+                    if(m_timestamping)
+                    {
+                        ts.user_ns = Timestamping::now_ns();
+                        ts.kernel_ns = Timestamping::rx_timestamp(
+                            buffer + sizeof(out) + msg.msg_namelen,
+                            out.controllen);
+                    }
+                    buffer[offset + size] = '\0'; // Null-terminate
+                    on_datagram(buffer + offset, size, client_addr, ts);
+                    ring.recycle(bid);
+                }
+                else if(cqe->res < 0 && cqe->res != -ENOBUFS)
+                    std::cerr << "Error receiving data: "
+                              << strerror(-cqe->res) << std::endl;
+
+                if(!(cqe->flags & IORING_CQE_F_MORE) && m_is_running &&
+                   !ring.prep_multishot_recvmsg(m_fd, &msg, 0, recv_data))
+                    lost = true;
+            });
+    }
+    if(lost)
+        std::cerr << "io_uring submission queue full, server loop stopped"
+                  << std::endl;
+#endif
+}
+
+void
+UDPServer::release_uring()
+{
+#ifdef __linux__
+    m_uring.reset();
+    if(m_wake_fd >= 0)
+        close(m_wake_fd);
+    m_wake_fd = -1;
+#endif
+}
 
 } // namespace Communication
@@ -0,0 +1,339 @@
+#include "uring.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
+
+namespace Communication
+{
+
+#ifdef __linux__
+static int
+sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, nullptr, 0);
+}
+
+static int
+sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+#endif
+
+URing::~URing() { close_ring(); }
+
+bool
+URing::supported()
+{
+#ifdef __linux__
+    static const bool s_supported = []()
+    {
+        // multishot recv and provided-buffer rings need linux >= 6.0
+        struct utsname u;
+        if(uname(&u) != 0)
+            return false;
+        int major = 0, minor = 0;
+        if(sscanf(u.release, "%d.%d", &major, &minor) != 2 || major < 6)
+            return false;
+
+        URing ring;
+        if(!ring.init(4))
+            return false;
+
+        const unsigned n_ops = 256;
+        size_t len = sizeof(struct io_uring_probe) +
+                     n_ops * sizeof(struct io_uring_probe_op);
+        struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, len);
+        if(probe == nullptr)
+            return false;
+        bool ok = sys_io_uring_register(ring.m_fd, IORING_REGISTER_PROBE,
+                                        probe, n_ops) == 0;
+        for(int op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_RECVMSG,
+                      IORING_OP_READ, IORING_OP_ASYNC_CANCEL})
+            ok = ok && op <= probe->last_op &&
+                 (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+        free(probe);
+
+        return ok && ring.setup_buffer_ring(0, 1, 64);
+    }();
+    return s_supported;
+#else
+    return false;
+#endif
+}
+
+bool
+URing::init(unsigned entries)
+{
+#ifdef __linux__
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    m_fd = sys_io_uring_setup(entries, &p);
+    if(m_fd < 0)
+        return false;
+
+    m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+        m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+
+    m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if(m_sq_ptr == MAP_FAILED)
+    {
+        m_sq_ptr = nullptr;
+        close_ring();
+        return false;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+        m_cq_ptr = m_sq_ptr;
+    else
+    {
+        m_cq_ptr = mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if(m_cq_ptr == MAP_FAILED)
+        {
+            m_cq_ptr = nullptr;
+            close_ring();
+            return false;
+        }
+    }
+
+    m_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe *)mmap(nullptr, m_sqes_size,
+                                         PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, m_fd,
+                                         IORING_OFF_SQES);
+    if(m_sqes == MAP_FAILED)
+    {
+        m_sqes = nullptr;
+        close_ring();
+        return false;
+    }
+
+    uint8_t *sq = (uint8_t *)m_sq_ptr;
+    m_sq_khead = (unsigned *)(sq + p.sq_off.head);
+    m_sq_ktail = (unsigned *)(sq + p.sq_off.tail);
+    m_sq_array = (unsigned *)(sq + p.sq_off.array);
+    m_sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    m_sq_entries = p.sq_entries;
+    m_sq_tail = *m_sq_ktail;
+
+    uint8_t *cq = (uint8_t *)m_cq_ptr;
+    m_cq_khead = (unsigned *)(cq + p.cq_off.head);
+    m_cq_ktail = (unsigned *)(cq + p.cq_off.tail);
+    m_cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+#else
+    (void)entries;
+    return false;
+#endif
+}
+
+void
+URing::close_ring()
+{
+#ifdef __linux__
+    if(m_buffers)
+        munmap(m_buffers, m_buffers_size);
+    if(m_buf_ring)
+        munmap(m_buf_ring, m_buf_ring_size);
+    if(m_sqes)
+        munmap(m_sqes, m_sqes_size);
+    if(m_cq_ptr && m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_size);
+    if(m_sq_ptr)
+        munmap(m_sq_ptr, m_sq_size);
+    m_buffers = nullptr;
+    m_buf_ring = nullptr;
+    m_sqes = nullptr;
+    m_cq_ptr = m_sq_ptr = nullptr;
+    if(m_fd >= 0)
+        close(m_fd);
+#endif
+    m_fd = -1;
+}
+
+#ifdef __linux__
+struct io_uring_sqe *
+URing::get_sqe()
+{
+    unsigned head = __atomic_load_n(m_sq_khead, __ATOMIC_ACQUIRE);
+    if(m_sq_tail - head >= m_sq_entries)
+    {
+        // hand the queued entries to the kernel, which frees their slots
+        submit(0);
+        head = __atomic_load_n(m_sq_khead, __ATOMIC_ACQUIRE);
+        if(m_sq_tail - head >= m_sq_entries)
+            return nullptr;
+    }
+    unsigned idx = m_sq_tail & m_sq_mask;
+    struct io_uring_sqe *sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[idx] = idx;
+    m_sq_tail++;
+    return sqe;
+}
+
+bool
+URing::prep_multishot_accept(int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if(sqe == nullptr)
+        return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool
+URing::prep_multishot_recv(int fd, uint16_t bgid, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if(sqe == nullptr)
+        return false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bgid;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool
+URing::prep_multishot_recvmsg(int fd,
+                              struct msghdr *msg,
+                              uint16_t bgid,
+                              uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if(sqe == nullptr)
+        return false;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bgid;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool
+URing::prep_read(int fd, void *buffer, unsigned size, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if(sqe == nullptr)
+        return false;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = size;
+    sqe->off = (uint64_t)-1; // current file position
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool
+URing::prep_cancel(uint64_t target, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if(sqe == nullptr)
+        return false;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+    return true;
+}
+
+int
+URing::submit(unsigned wait_nr)
+{
+    __atomic_store_n(m_sq_ktail, m_sq_tail, __ATOMIC_RELEASE);
+    unsigned to_submit =
+        m_sq_tail - __atomic_load_n(m_sq_khead, __ATOMIC_ACQUIRE);
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    m_enter_calls++;
+    int ret = sys_io_uring_enter(m_fd, to_submit, wait_nr, flags);
+    return ret < 0 ? -errno : ret;
+}
+
+bool
+URing::setup_buffer_ring(uint16_t bgid, uint16_t n_buffers, uint32_t buffer_size)
+{
+    if(n_buffers == 0 || (n_buffers & (n_buffers - 1)) != 0)
+        return false;
+
+    m_buf_ring_size = n_buffers * sizeof(struct io_uring_buf);
+    void *ring = mmap(nullptr, m_buf_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED)
+        return false;
+    m_buf_ring = (struct io_uring_buf_ring *)ring;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring;
+    reg.ring_entries = n_buffers;
+    reg.bgid = bgid;
+    if(sys_io_uring_register(m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+    {
+        munmap(ring, m_buf_ring_size);
+        m_buf_ring = nullptr;
+        return false;
+    }
+
+    m_buffers_size = (size_t)n_buffers * buffer_size;
+    void *buffers = mmap(nullptr, m_buffers_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(buffers == MAP_FAILED)
+        return false;
+    m_buffers = (uint8_t *)buffers;
+    m_buffer_size = buffer_size;
+    m_buf_mask = n_buffers - 1;
+    m_buf_tail = 0;
+    for(uint16_t bid = 0; bid < n_buffers; bid++) recycle(bid);
+    return true;
+}
+
+void
+URing::recycle(uint16_t bid)
+{
+    // the bufs[] flexible array is not laid out the same way by C++
+    // compilers, index the ring directly
+    struct io_uring_buf *buf =
+        (struct io_uring_buf *)m_buf_ring + (m_buf_tail & m_buf_mask);
+    buf->addr = (uint64_t)(uintptr_t)buffer(bid);
+    buf->len = m_buffer_size;
+    buf->bid = bid;
+    m_buf_tail++;
+    __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+}
+#endif
+
+} // namespace Communication
@@ -0,0 +1,190 @@
+#include "zerocopy.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+
+#if defined(linux) || defined(__APPLE__)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define HAS_ZEROCOPY 1
+#endif
+
+namespace Communication
+{
+
+ZeroCopy::ZeroCopy(int fd,
+                   size_t threshold,
+                   std::shared_ptr<ErrorQueue> errors)
+    : m_fd(fd), m_threshold(threshold),
+      m_errors(errors ? std::move(errors) : std::make_shared<ErrorQueue>(fd))
+{
+#ifdef HAS_ZEROCOPY
+    int one = 1;
+    m_enabled = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+    if(m_enabled)
+        m_errors->want_completions();
+#endif
+}
+
+int
+ZeroCopy::send(const void *buffer, size_t size, uint64_t *id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(id)
+        *id = 0;
+    if(m_fd < 0)
+        return -1;
+
+    const char *bytes = (const char *)buffer;
+    size_t sent = 0;
+#ifdef HAS_ZEROCOPY
+    bool zerocopy = m_enabled && size >= m_threshold;
+#endif
+    while(sent < size)
+    {
+        int flags = SEND_FLAGS;
+#ifdef HAS_ZEROCOPY
+        if(zerocopy)
+            flags |= MSG_ZEROCOPY;
+#endif
+        ssize_t n = ::send(m_fd, bytes + sent, size - sent, flags);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+#ifdef HAS_ZEROCOPY
+            if(errno == ENOBUFS && zerocopy)
+            {
+                // too many notifications pending (optmem limit): read them
+                // and copy the rest of this buffer
+                read_notifications();
+                zerocopy = false;
+                continue;
+            }
+#endif
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break; // non-blocking socket full: the caller sends the rest
+            return -1;
+        }
+#ifdef HAS_ZEROCOPY
+        if(zerocopy)
+        {
+            m_sent++;
+            if(id)
+                *id = m_sent;
+        }
+#endif
+        sent += n;
+    }
+    return (int)sent;
+}
+
+uint64_t
+ZeroCopy::poll()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    read_notifications();
+    return m_completed;
+}
+
+bool
+ZeroCopy::done(uint64_t id)
+{
+    return poll() >= id;
+}
+
+bool
+ZeroCopy::wait(uint64_t id, int timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeout_ms);
+    while(true)
+    {
+        int fd;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            read_notifications();
+            if(m_completed >= id)
+                return true;
+            fd = m_fd;
+        }
+        int slice = 10;
+        if(timeout_ms >= 0)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if(left.count() <= 0)
+                return false;
+            slice = std::min<int>(slice, left.count());
+        }
+#if defined(linux) || defined(__APPLE__)
+        // notifications raise POLLERR. Another thread (e.g. a server I/O
+        // thread) may read them first, hence the short slices.
+        struct pollfd pfd = {fd, 0, 0};
+        ::poll(&pfd, 1, slice);
+#else
+        (void)fd;
+        (void)slice;
+        return true;
+#endif
+    }
+}
+
+void
+ZeroCopy::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fd = -1;
+    m_completed = m_sent;
+    m_early.clear();
+}
+
+void
+ZeroCopy::complete(uint32_t lo, uint32_t hi)
+{
+    // kernel ids are 32 bits wide, the pending ones are close to m_completed
+    uint64_t first = m_completed + (uint32_t)(lo - (uint32_t)m_completed);
+    uint64_t last = first + (uint32_t)(hi - lo);
+    if(first > m_completed)
+    {
+        m_early[first] = std::max(m_early[first], last);
+        return;
+    }
+    m_completed = std::max(m_completed, last + 1);
+    while(!m_early.empty() && m_early.begin()->first <= m_completed)
+    {
+        m_completed = std::max(m_completed, m_early.begin()->second + 1);
+        m_early.erase(m_early.begin());
+    }
+}
+
+void
+ZeroCopy::read_notifications()
+{
+#ifdef HAS_ZEROCOPY
+    if(m_fd < 0 || !m_enabled || m_completed == m_sent)
+        return;
+    for(const ErrorQueue::Completion &c : m_errors->take_completions())
+    {
+        if(c.copied)
+            m_copied += (uint32_t)(c.hi - c.lo) + 1;
+        complete(c.lo, c.hi);
+    }
+#endif
+}
+
+} // namespace Communication
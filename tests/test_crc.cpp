@@ -15,7 +15,9 @@
 
 #include "test_utils.hpp"
 #include "tcp_client.hpp"
+#include "crc16.hpp"
 #include <cstring>
+#include <vector>
 
 using namespace Communication;
 
@@ -149,6 +151,247 @@ bool test_crc_table_no_overflow()
     return true;
 }
 
+// Bit by bit CRC-16 (poly 0x1021, init 0) with the byte swap of Client::CRC
+static uint16_t reference_crc(const uint8_t *buf, size_t n)
+{
+    uint16_t crc = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        crc ^= buf[i] << 8;
+        for(int b = 0; b < 8; b++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return (crc >> 8) | (crc << 8);
+}
+
+// Test: known check value ("123456789" -> 0x31C3 for CRC-16/XMODEM)
+bool test_crc_check_value()
+{
+    CRCTestClient client;
+
+    uint8_t data[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    TEST_ASSERT_EQ(0xC331, client.test_crc(data, 9));
+    return true;
+}
+
+// Test: every kernel gives the same result as the reference for all lengths,
+// alignments and initial values
+bool test_crc_kernels_match()
+{
+    CRCTestClient client;
+
+    std::vector<uint8_t> data(4096 + 16);
+    uint32_t seed = 12345;
+    for(auto &b : data)
+    {
+        seed = seed * 1103515245 + 12345;
+        b = seed >> 16;
+    }
+
+    for(int k = 0; k < CRC16::N_KERNELS; k++)
+    {
+        CRC16::Kernel kernel = (CRC16::Kernel)k;
+        for(size_t n = 0; n < 600; n += (n < 300 ? 1 : 37))
+            for(size_t offset = 0; offset < 3; offset++)
+            {
+                uint16_t crc = CRC16::update(kernel, 0, &data[offset], n);
+                TEST_ASSERT_EQ(reference_crc(&data[offset], n),
+                               (uint16_t)((crc >> 8) | (crc << 8)));
+            }
+        // chained calls with a non zero register
+        uint16_t crc = CRC16::update(kernel, 0xFFFF, data.data(), 1000);
+        crc = CRC16::update(kernel, crc, data.data() + 1000, 3096);
+        TEST_ASSERT_EQ(CRC16::update(CRC16::TABLE, 0xFFFF, data.data(), 4096),
+                       crc);
+    }
+
+    TEST_ASSERT_EQ(reference_crc(data.data(), 4096),
+                   client.test_crc(data.data(), 4096));
+    return true;
+}
+
+// Test: check values of the CRC policies, tables built at compile time
+bool test_crc_policies()
+{
+    static_assert(CRCTable<0x1021, false, 1>().t[0][1] == 0x1021,
+                  "constexpr table");
+    static_assert(CRCTable<0x8005, true, 1>().t[0][0x80] == 0xA001,
+                  "constexpr reflected table");
+
+    const uint8_t data[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    TEST_ASSERT_EQ(0x31C3, CRC16_XMODEM::compute(data, 9));
+    TEST_ASSERT_EQ(0x29B1, CRC16_CCITT_FALSE::compute(data, 9));
+    TEST_ASSERT_EQ(0x2189, CRC16_KERMIT::compute(data, 9));
+    TEST_ASSERT_EQ(0x906E, CRC16_X25::compute(data, 9));
+    TEST_ASSERT_EQ(0x4B37, CRC16_MODBUS::compute(data, 9));
+    TEST_ASSERT_EQ(0xBB3D, CRC16_ARC::compute(data, 9));
+
+    // slicing loop and byte loop give the same result
+    uint8_t long_data[100];
+    for(int i = 0; i < 100; i++) long_data[i] = i * 7;
+    uint16_t crc = CRC16_MODBUS::init;
+    for(int i = 0; i < 100; i++) crc = CRC16_MODBUS::update(crc, long_data + i, 1);
+    TEST_ASSERT_EQ(CRC16_MODBUS::compute(long_data, 100), crc);
+    return true;
+}
+
+// Test: a client can switch variant, the trailer follows its byte order
+bool test_crc_client_variant()
+{
+    CRCTestClient client;
+
+    uint8_t data[11] = {'1', '2', '3', '4', '5', '6', '7', '8', '9', 0, 0};
+    client.set_crc(CRC16_MODBUS::spec());
+    client.get_crc().append(data, 9);
+    TEST_ASSERT_EQ(0x37, data[9]); // MODBUS: LSB first
+    TEST_ASSERT_EQ(0x4B, data[10]);
+    TEST_ASSERT(client.test_check_crc(data, 11));
+
+    client.set_crc(CRC16_XMODEM::spec());
+    TEST_ASSERT(!client.test_check_crc(data, 11));
+    client.get_crc().append(data, 9);
+    TEST_ASSERT_EQ(0x31, data[9]); // XMODEM: MSB first, as Client::CRC()
+    TEST_ASSERT_EQ(0xC3, data[10]);
+    TEST_ASSERT(client.test_check_crc(data, 11));
+    return true;
+}
+
+// Test: copying kernels copy the data and give the same CRC
+bool test_crc_update_copy()
+{
+    std::vector<uint8_t> src(1000), dst(1000);
+    for(size_t i = 0; i < src.size(); i++) src[i] = i * 13 + 1;
+
+    for(int k = 0; k < CRC16::N_KERNELS; k++)
+    {
+        CRC16::Kernel kernel = (CRC16::Kernel)k;
+        for(size_t n : {0, 1, 15, 16, 127, 128, 129, 200, 1000})
+        {
+            std::fill(dst.begin(), dst.end(), 0);
+            uint16_t crc = CRC16::update_copy(kernel, 0x1234, dst.data(),
+                                              src.data(), n);
+            TEST_ASSERT_EQ(CRC16::update(CRC16::TABLE, 0x1234, src.data(), n),
+                           crc);
+            TEST_ASSERT_EQ(0, memcmp(dst.data(), src.data(), n));
+            if(n < dst.size())
+                TEST_ASSERT_EQ(0, dst[n]);
+        }
+    }
+
+    std::fill(dst.begin(), dst.end(), 0);
+    TEST_ASSERT_EQ(CRC16_MODBUS::update(0xFFFF, src.data(), 1000),
+                   CRC16_MODBUS::update_copy(0xFFFF, dst.data(), src.data(), 1000));
+    TEST_ASSERT(dst == src);
+    return true;
+}
+
+// Test: batched verification gives the same verdict as frame by frame
+bool test_crc_batch_check()
+{
+    CRCTestClient client;
+
+    const size_t frame_size = 48, n_frames = 70; // 2 bitmap words
+    std::vector<uint8_t> frames(frame_size * n_frames);
+    for(size_t i = 0; i < n_frames; i++)
+    {
+        uint8_t *f = &frames[i * frame_size];
+        for(size_t j = 0; j < frame_size - 2; j++) f[j] = i + j * 5;
+        client.get_crc().append(f, frame_size - 2);
+        if(i % 3 == 1)
+            f[i % (frame_size - 2)] ^= 0x40; // corrupt
+    }
+
+    uint64_t valid[2];
+    size_t n_valid = client.check_CRC(frames.data(), frame_size, n_frames, valid);
+    size_t expected = 0;
+    for(size_t i = 0; i < n_frames; i++)
+    {
+        bool ok = client.test_check_crc(&frames[i * frame_size], frame_size);
+        expected += ok;
+        TEST_ASSERT_EQ(ok, (bool)((valid[i / 64] >> (i % 64)) & 1));
+    }
+    TEST_ASSERT_EQ(expected, n_valid);
+    TEST_ASSERT_EQ(n_frames - (n_frames + 1) / 3, n_valid);
+
+    // every kernel, every length
+    for(int k = 0; k < CRC16::N_KERNELS; k++)
+        for(size_t n = 0; n < 100; n++)
+        {
+            const uint8_t *buf[4];
+            uint16_t crc[4];
+            for(int l = 0; l < 4; l++)
+            {
+                buf[l] = &frames[l * 101];
+                crc[l] = l * 0x1111;
+            }
+            CRC16::update_x4((CRC16::Kernel)k, crc, buf, n);
+            for(int l = 0; l < 4; l++)
+                TEST_ASSERT_EQ(CRC16::update(CRC16::TABLE, l * 0x1111, buf[l], n),
+                               crc[l]);
+        }
+
+    // list of frames of different sizes, with a reflected variant
+    const CRCSpec modbus = CRC16_MODBUS::spec();
+    std::vector<std::vector<uint8_t>> list;
+    std::vector<const uint8_t *> ptrs;
+    std::vector<size_t> sizes;
+    for(size_t i = 0; i < 9; i++)
+    {
+        list.emplace_back(3 + i * 11);
+        for(size_t j = 0; j < list[i].size(); j++) list[i][j] = i * j;
+        modbus.append(list[i].data(), list[i].size() - 2);
+    }
+    list[5][0] ^= 1;
+    for(auto &f : list)
+    {
+        ptrs.push_back(f.data());
+        sizes.push_back(f.size());
+    }
+    TEST_ASSERT_EQ(8u, modbus.check_frames(ptrs.data(), sizes.data(), 9, valid));
+    TEST_ASSERT_EQ(0x1DFu, valid[0]);
+    return true;
+}
+
+// Test: the accumulator gives the same CRC whatever the fragmentation
+bool test_crc_accumulator()
+{
+    uint8_t data[300];
+    for(int i = 0; i < 300; i++) data[i] = i * 11 + 3;
+
+    for(const CRCSpec &spec : {CRC16_XMODEM::spec(), CRC16_X25::spec()})
+    {
+        uint16_t expected = spec.compute(data, 300);
+
+        CRCAccumulator crc(spec);
+        crc.update(data, 1).update(data + 1, 130).update(data + 131, 0);
+        crc.update(data + 131, 169);
+        TEST_ASSERT_EQ(expected, crc.finalize());
+        TEST_ASSERT_EQ(300u, crc.length());
+
+        struct iovec iov[3] = {{data, 7}, {data + 7, 200}, {data + 207, 93}};
+        crc.reset();
+        crc.update(iov, 3);
+        TEST_ASSERT_EQ(expected, crc.finalize());
+
+        uint8_t copy[300];
+        crc.reset();
+        crc.update_copy(copy, data, 150).update_copy(copy + 150, data + 150, 150);
+        TEST_ASSERT_EQ(expected, crc.finalize());
+        TEST_ASSERT_EQ(0, memcmp(copy, data, 300));
+
+        uint8_t trailer[2];
+        crc.store(trailer);
+        TEST_ASSERT(crc.verify(trailer));
+        TEST_ASSERT_EQ(expected, spec.load(trailer));
+        trailer[0] ^= 1;
+        TEST_ASSERT(!crc.verify(trailer));
+    }
+
+    CRCAccumulator empty;
+    TEST_ASSERT_EQ(0, empty.finalize());
+    return true;
+}
+
 int main()
 {
     Test::TestRunner runner;
@@ -160,6 +403,13 @@ int main()
     runner.add_test("CRC of empty data", test_crc_empty_data);
     runner.add_test("CRC of single byte", test_crc_single_byte);
     runner.add_test("CRC table no overflow", test_crc_table_no_overflow);
+    runner.add_test("CRC check value", test_crc_check_value);
+    runner.add_test("CRC kernels match", test_crc_kernels_match);
+    runner.add_test("CRC policies", test_crc_policies);
+    runner.add_test("CRC client variant", test_crc_client_variant);
+    runner.add_test("CRC update with copy", test_crc_update_copy);
+    runner.add_test("CRC batch check", test_crc_batch_check);
+    runner.add_test("CRC accumulator", test_crc_accumulator);
 
     return runner.run();
 }
@@ -0,0 +1,170 @@
+/**
+ * @file test_framer.cpp
+ * @brief Unit tests for the Framer (fixed, length prefix and delimiter)
+ *
+ * Usage:
+ *   ./test_framer
+ *
+ * Example: Cutting a FIFO into frames
+ *   Communication::Framer framer = Framer::length_prefix(2);
+ *   const uint8_t *frame;
+ *   size_t size;
+ *   while(framer.next(fifo, frame, size) == Framer::FRAME)
+ *       handle(frame, size);
+ */
+
+#include "test_utils.hpp"
+#include "framer.hpp"
+#include <cstring>
+#include <vector>
+
+using namespace Communication;
+
+// Test: fixed size frames come out one by one, in place
+bool test_framer_fixed()
+{
+    Framer framer = Framer::fixed(4);
+    RingBuffer fifo(64);
+    const uint8_t data[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    fifo.push(data, 10);
+
+    const uint8_t *frame;
+    size_t size;
+    TEST_ASSERT_EQ(Framer::FRAME, framer.next(fifo, frame, size));
+    TEST_ASSERT_EQ(4u, size);
+    TEST_ASSERT_EQ(0, memcmp(frame, data, 4));
+    size_t len;
+    TEST_ASSERT(frame + 4 == fifo.read_ptr(len)); // no copy
+    TEST_ASSERT_EQ(Framer::FRAME, framer.next(fifo, frame, size));
+    TEST_ASSERT_EQ(0, memcmp(frame, data + 4, 4));
+    TEST_ASSERT_EQ(Framer::INCOMPLETE, framer.next(fifo, frame, size));
+    TEST_ASSERT_EQ(2u, fifo.size());
+    return true;
+}
+
+// Test: length header of every width and byte order
+bool test_framer_length_prefix()
+{
+    for(int width : {1, 2, 4, 8})
+        for(bool big_endian : {true, false})
+        {
+            Framer framer = Framer::length_prefix(width, big_endian);
+            RingBuffer fifo(64);
+            uint8_t header[8] = {0};
+            header[big_endian ? width - 1 : 0] = 3;
+            fifo.push(header, width);
+            fifo.push((const uint8_t *)"ab", 2);
+
+            const uint8_t *frame;
+            size_t size;
+            TEST_ASSERT_EQ(Framer::INCOMPLETE, framer.next(fifo, frame, size));
+            fifo.push((const uint8_t *)"cd", 2);
+            TEST_ASSERT_EQ(Framer::FRAME, framer.next(fifo, frame, size));
+            TEST_ASSERT_EQ(3u, size);
+            TEST_ASSERT_EQ(0, memcmp(frame, "abc", 3));
+            TEST_ASSERT_EQ(1u, fifo.size());
+        }
+
+    // a length above max_size loses the stream
+    Framer framer = Framer::length_prefix(2, true, false, 100);
+    RingBuffer fifo(64);
+    const uint8_t header[] = {0x10, 0x00, 1, 2, 3};
+    fifo.push(header, 5);
+    const uint8_t *frame;
+    size_t size;
+    TEST_ASSERT_EQ(Framer::OVERSIZED, framer.next(fifo, frame, size));
+    TEST_ASSERT(fifo.empty());
+    return true;
+}
+
+// Test: delimiter split across pushes, and frames past max_size
+bool test_framer_delimiter()
+{
+    Framer framer = Framer::delimiter("\r\n", false, 16);
+    RingBuffer fifo(64);
+    const uint8_t *frame;
+    size_t size;
+
+    fifo.push((const uint8_t *)"hello\r", 6);
+    TEST_ASSERT_EQ(Framer::INCOMPLETE, framer.next(fifo, frame, size));
+    fifo.push((const uint8_t *)"\nworld\r\n", 8);
+    TEST_ASSERT_EQ(Framer::FRAME, framer.next(fifo, frame, size));
+    TEST_ASSERT_EQ(5u, size);
+    TEST_ASSERT_EQ(0, memcmp(frame, "hello", 5));
+    TEST_ASSERT_EQ(Framer::FRAME, framer.next(fifo, frame, size));
+    TEST_ASSERT_EQ(0, memcmp(frame, "world", 5));
+    TEST_ASSERT_EQ(Framer::INCOMPLETE, framer.next(fifo, frame, size));
+
+    fifo.push((const uint8_t *)"0123456789abcdefgh", 18);
+    TEST_ASSERT_EQ(Framer::OVERSIZED, framer.next(fifo, frame, size));
+    TEST_ASSERT(fifo.empty());
+    return true;
+}
+
+// Test: CRC checked for each mode, bad frames consumed
+bool test_framer_crc()
+{
+    const CRCSpec crc = CRC16_MODBUS::spec();
+    uint8_t lp[2 + 5 + 2] = {0, 5, 'f', 'r', 'a', 'm', 'e'};
+    crc.append(lp, 7);
+    uint8_t dl[5 + 2 + 1] = {'f', 'r', 'a', 'm', 'e', 0, 0, '\n'};
+    crc.append(dl, 5);
+
+    Framer framers[] = {Framer::fixed(9, true).set_crc(crc),
+                        Framer::length_prefix(2, true, true).set_crc(crc),
+                        Framer::delimiter("\n", true).set_crc(crc)};
+    const uint8_t *wire[] = {lp, lp, dl};
+    size_t wire_size[] = {9, 9, 8};
+    const uint8_t *payload[] = {lp, lp + 2, dl}; // fixed keeps the header
+    size_t payload_size[] = {7, 5, 5};
+    for(int i = 0; i < 3; i++)
+    {
+        RingBuffer fifo(64);
+        std::vector<uint8_t> bad(wire[i], wire[i] + wire_size[i]);
+        bad[3] ^= 1;
+        fifo.push(wire[i], wire_size[i]);
+        fifo.push(bad.data(), bad.size());
+        fifo.push(wire[i], wire_size[i]);
+
+        const uint8_t *frame;
+        size_t size;
+        TEST_ASSERT_EQ(Framer::FRAME, framers[i].next(fifo, frame, size));
+        TEST_ASSERT_EQ(payload_size[i], size);
+        TEST_ASSERT_EQ(0, memcmp(frame, payload[i], size));
+        TEST_ASSERT_EQ(Framer::BAD_CRC, framers[i].next(fifo, frame, size));
+        TEST_ASSERT_EQ(Framer::FRAME, framers[i].next(fifo, frame, size));
+        TEST_ASSERT(fifo.empty());
+    }
+    return true;
+}
+
+// Test: a frame wrapping around the FIFO is copied once
+bool test_framer_wrap()
+{
+    Framer framer = Framer::fixed(6);
+    RingBuffer fifo(8, 0);
+    const uint8_t data[] = {0, 1, 2, 3, 4, 5};
+    const uint8_t *frame;
+    size_t size;
+    fifo.push(data, 6);
+    fifo.push(data, 2);
+    TEST_ASSERT_EQ(Framer::FRAME, framer.next(fifo, frame, size));
+    fifo.push(data + 2, 4); // wraps
+    TEST_ASSERT_EQ(Framer::FRAME, framer.next(fifo, frame, size));
+    TEST_ASSERT_EQ(6u, size);
+    TEST_ASSERT_EQ(0, memcmp(frame, data, 6));
+    return true;
+}
+
+int main()
+{
+    Test::TestRunner runner;
+
+    runner.add_test("Framer fixed", test_framer_fixed);
+    runner.add_test("Framer length prefix", test_framer_length_prefix);
+    runner.add_test("Framer delimiter", test_framer_delimiter);
+    runner.add_test("Framer CRC", test_framer_crc);
+    runner.add_test("Framer wrap", test_framer_wrap);
+
+    return runner.run();
+}
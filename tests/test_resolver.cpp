@@ -0,0 +1,106 @@
+/**
+ * @file test_resolver.cpp
+ * @brief Unit tests for the caching name Resolver
+ *
+ * Usage:
+ *   ./test_resolver
+ *
+ * Example: Resolving a name without blocking
+ *   auto future = Communication::Resolver::instance().resolve_async("host");
+ *   ... // other work
+ *   for(auto &addr : future.get().with_port(80))
+ *       connect_to(addr);
+ */
+
+#include "test_utils.hpp"
+#include "resolver.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <thread>
+#include <vector>
+
+using namespace Communication;
+
+// Test: numeric addresses are parsed without touching the cache
+bool test_resolver_numeric()
+{
+    Resolver resolver;
+    Resolution r = resolver.resolve("127.0.0.1");
+    TEST_ASSERT(r.error.empty());
+    TEST_ASSERT_EQ(1u, r.addrs.size());
+    std::vector<sockaddr_storage> addrs = r.with_port(8080);
+    const sockaddr_in *sin = (const sockaddr_in *)&addrs[0];
+    TEST_ASSERT_EQ(AF_INET, sin->sin_family);
+    TEST_ASSERT_EQ(8080, ntohs(sin->sin_port));
+    TEST_ASSERT_EQ(htonl(INADDR_LOOPBACK), sin->sin_addr.s_addr);
+
+    r = resolver.resolve("::1");
+    TEST_ASSERT_EQ(1u, r.with_port(80, AF_INET6).size());
+    TEST_ASSERT_EQ(0u, r.with_port(80, AF_INET).size());
+    TEST_ASSERT_EQ(0u, resolver.hits() + resolver.misses());
+    return true;
+}
+
+// Test: the second lookup of a name is served from the cache
+bool test_resolver_cache()
+{
+    Resolver resolver;
+    Resolution r = resolver.resolve("localhost");
+    TEST_ASSERT(r.error.empty());
+    TEST_ASSERT(!r.addrs.empty());
+    TEST_ASSERT_EQ(1u, resolver.misses());
+
+    std::shared_future<Resolution> f = resolver.resolve_async("localhost");
+    TEST_ASSERT(f.wait_for(std::chrono::seconds(0)) ==
+                std::future_status::ready);
+    TEST_ASSERT_EQ(r.addrs.size(), f.get().addrs.size());
+    TEST_ASSERT_EQ(1u, resolver.hits());
+
+    resolver.clear();
+    resolver.resolve("localhost");
+    TEST_ASSERT_EQ(2u, resolver.misses());
+    return true;
+}
+
+// Test: an expired entry is served while it is refreshed
+bool test_resolver_stale()
+{
+    Resolver resolver(0); // every answer is expired at once
+    resolver.resolve("localhost");
+    Resolution r = resolver.resolve("localhost");
+    TEST_ASSERT(!r.addrs.empty());
+    TEST_ASSERT_EQ(1u, resolver.misses());
+    TEST_ASSERT_EQ(1u, resolver.hits());
+    return true;
+}
+
+// Test: concurrent lookups of a name from many threads
+bool test_resolver_concurrent()
+{
+    Resolver resolver;
+    std::vector<std::thread> threads;
+    std::atomic<int> ok{0};
+    for(int i = 0; i < 16; i++)
+        threads.emplace_back(
+            [&]()
+            {
+                if(!resolver.resolve("localhost").addrs.empty())
+                    ok++;
+            });
+    for(auto &t : threads) t.join();
+    TEST_ASSERT_EQ(16, ok.load());
+    TEST_ASSERT_EQ(16u, resolver.hits() + resolver.misses());
+    return true;
+}
+
+int main()
+{
+    Test::TestRunner runner;
+
+    runner.add_test("Resolver numeric address", test_resolver_numeric);
+    runner.add_test("Resolver cache", test_resolver_cache);
+    runner.add_test("Resolver stale entry", test_resolver_stale);
+    runner.add_test("Resolver concurrent lookups", test_resolver_concurrent);
+
+    return runner.run();
+}
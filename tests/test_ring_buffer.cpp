@@ -0,0 +1,149 @@
+/**
+ * @file test_ring_buffer.cpp
+ * @brief Unit tests for the RingBuffer byte FIFO
+ *
+ * Usage:
+ *   ./test_ring_buffer
+ *
+ * Example: Using the ring buffer in a Client implementation
+ *   Communication::RingBuffer fifo(4096);
+ *   fifo.push(data, n);              // bulk append
+ *   if(fifo.size() >= 4)
+ *       fifo.pop(header, 4);         // bulk remove
+ */
+
+#include "test_utils.hpp"
+#include "ring_buffer.hpp"
+#include <cstring>
+#include <vector>
+
+using namespace Communication;
+
+// Test: capacity is rounded up to a power of two
+bool test_ring_capacity_pow2()
+{
+    RingBuffer fifo(1000);
+    TEST_ASSERT_EQ(1024u, fifo.capacity());
+    TEST_ASSERT(fifo.empty());
+    return true;
+}
+
+// Test: push then pop returns the same bytes
+bool test_ring_push_pop()
+{
+    RingBuffer fifo(16);
+    const uint8_t data[] = {1, 2, 3, 4, 5};
+    TEST_ASSERT_EQ(5u, fifo.push(data, 5));
+    TEST_ASSERT_EQ(5u, fifo.size());
+
+    uint8_t out[8] = {0};
+    TEST_ASSERT_EQ(5u, fifo.pop(out, 8));
+    TEST_ASSERT_EQ(0, memcmp(out, data, 5));
+    TEST_ASSERT(fifo.empty());
+    return true;
+}
+
+// Test: data wrapping around the end of the storage stays ordered
+bool test_ring_wrap_around()
+{
+    RingBuffer fifo(8, 0); // fixed capacity
+    uint8_t in[6] = {0, 1, 2, 3, 4, 5};
+    uint8_t out[8] = {0};
+    fifo.push(in, 6);
+    fifo.pop(out, 4);
+    fifo.push(in, 6); // wraps
+    TEST_ASSERT_EQ(8u, fifo.size());
+
+    size_t n;
+    fifo.read_ptr(n);
+    TEST_ASSERT_EQ(4u, n); // first contiguous segment stops at the end
+
+    TEST_ASSERT_EQ(8u, fifo.pop(out, 8));
+    const uint8_t expected[8] = {4, 5, 0, 1, 2, 3, 4, 5};
+    TEST_ASSERT_EQ(0, memcmp(out, expected, 8));
+    return true;
+}
+
+// Test: peek with offset does not consume
+bool test_ring_peek()
+{
+    RingBuffer fifo(16);
+    const uint8_t data[] = {10, 20, 30, 40};
+    fifo.push(data, 4);
+
+    uint8_t out[2] = {0};
+    TEST_ASSERT_EQ(2u, fifo.peek(out, 2, 1));
+    TEST_ASSERT_EQ(20, out[0]);
+    TEST_ASSERT_EQ(30, out[1]);
+    TEST_ASSERT_EQ(40, fifo[3]);
+    TEST_ASSERT_EQ(4u, fifo.size());
+    TEST_ASSERT_EQ(0u, fifo.peek(out, 2, 4));
+    return true;
+}
+
+// Test: buffer grows up to max_capacity, then only stores what fits
+bool test_ring_capacity_policy()
+{
+    RingBuffer fifo(4, 16);
+    std::vector<uint8_t> data(32);
+    for(size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)i;
+
+    TEST_ASSERT_EQ(10u, fifo.push(data.data(), 10));
+    TEST_ASSERT_EQ(16u, fifo.capacity());
+    TEST_ASSERT_EQ(6u, fifo.push(data.data() + 10, 20)); // full
+    TEST_ASSERT_EQ(16u, fifo.size());
+
+    uint8_t out[16];
+    fifo.pop(out, 16);
+    TEST_ASSERT_EQ(0, memcmp(out, data.data(), 16));
+    return true;
+}
+
+// Test: write_ptr/commit receive data in place
+bool test_ring_write_in_place()
+{
+    RingBuffer fifo(8, 0);
+    size_t n;
+    uint8_t *dst = fifo.write_ptr(n);
+    TEST_ASSERT_EQ(8u, n);
+    memcpy(dst, "abc", 3);
+    fifo.commit(3);
+
+    uint8_t out[3];
+    TEST_ASSERT_EQ(3u, fifo.pop(out, 3));
+    TEST_ASSERT_EQ(0, memcmp(out, "abc", 3));
+    return true;
+}
+
+// Test: find a sequence, including one split by the wrap around
+bool test_ring_find()
+{
+    RingBuffer fifo(8, 0);
+    uint8_t in[6] = {'a', 'b', 'c', 'd', '\r', '\n'};
+    uint8_t out[6];
+    fifo.push(in, 6);
+    TEST_ASSERT_EQ(4u, fifo.find((const uint8_t *)"\r\n", 2));
+    TEST_ASSERT_EQ(RingBuffer::npos, fifo.find((const uint8_t *)"\r\n", 2, 5));
+    fifo.pop(out, 4);
+    fifo.push(in, 6); // "\r\nabcd\r\n" wrapping at 8
+    TEST_ASSERT_EQ(0u, fifo.find((const uint8_t *)"\r\n", 2));
+    TEST_ASSERT_EQ(6u, fifo.find((const uint8_t *)"\r\n", 2, 1));
+    TEST_ASSERT_EQ(3u, fifo.find((const uint8_t *)"bcd", 3));
+    TEST_ASSERT_EQ(RingBuffer::npos, fifo.find((const uint8_t *)"da", 2));
+    return true;
+}
+
+int main()
+{
+    Test::TestRunner runner;
+
+    runner.add_test("Ring capacity is a power of two", test_ring_capacity_pow2);
+    runner.add_test("Ring push/pop", test_ring_push_pop);
+    runner.add_test("Ring wrap around", test_ring_wrap_around);
+    runner.add_test("Ring peek", test_ring_peek);
+    runner.add_test("Ring capacity policy", test_ring_capacity_policy);
+    runner.add_test("Ring write in place", test_ring_write_in_place);
+    runner.add_test("Ring find", test_ring_find);
+
+    return runner.run();
+}
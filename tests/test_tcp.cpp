@@ -28,6 +28,7 @@
 #include "tcp_client.hpp"
 #include <thread>
 #include <chrono>
+#include <vector>
 #include <atomic>
 #include <cstring>
 
@@ -143,7 +144,7 @@ bool test_tcp_server_fifo()
         std::this_thread::sleep_for(std::chrono::milliseconds(200));
 
         // Get client sockets
-        auto &clients = server.get_clients();
+        auto clients = server.get_clients();
         if(!clients.empty())
         {
             SOCKET client_sock = *clients.begin();
@@ -320,6 +321,1279 @@ bool test_tcp_new_client_callback()
     return true;
 }
 
+// Test: REACTOR engine buffers data and tracks clients
+bool test_tcp_reactor_engine()
+{
+    TCPServer server(TEST_PORT + 7);
+    server.set_engine(TCPServer::REACTOR, 2);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client1(-1);
+    TCP client2(-1);
+    try
+    {
+        client1.open_connection("127.0.0.1", TEST_PORT + 7, 2);
+        client2.open_connection("127.0.0.1", TEST_PORT + 7, 2);
+
+        const char *msg = "Reactor Data";
+        client1.writeS(msg, strlen(msg));
+        client2.writeS(msg, strlen(msg));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        TEST_ASSERT_EQ(2u, server.get_clients().size());
+        for(SOCKET s : server.get_clients())
+        {
+            uint8_t buffer[256] = {0};
+            int result = server.read_byte(s, buffer, strlen(msg), true, true);
+            TEST_ASSERT_EQ((int)strlen(msg), result);
+            TEST_ASSERT_EQ(0, memcmp(buffer, msg, strlen(msg)));
+        }
+
+        // disconnections are detected by the reactor
+        client1.close_connection();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        client2.close_connection();
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    TEST_ASSERT(server.get_clients().empty());
+    return true;
+}
+
+// Test: IO_URING engine (or its thread fallback) buffers data
+bool test_tcp_uring_engine()
+{
+    TCPServer server(TEST_PORT + 8);
+    server.set_engine(Server::IO_URING);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 8, 2);
+
+        const char *msg = "io_uring Data";
+        for(int i = 0; i < 100; i++) client.writeS(msg, strlen(msg));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+        TEST_ASSERT_EQ(100 * (int)strlen(msg), server.is_available(s));
+        uint8_t buffer[256] = {0};
+        int result = server.read_byte(s, buffer, strlen(msg), true, true);
+        TEST_ASSERT_EQ((int)strlen(msg), result);
+        TEST_ASSERT_EQ(0, memcmp(buffer, msg, strlen(msg)));
+
+        client.close_connection();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        TEST_ASSERT(server.get_clients().empty());
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_blocking_read_wakeup()
+{
+    TCPServer server(TEST_PORT + 9, 10, -1);
+    server.set_engine(Server::REACTOR);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 9, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+        uint8_t buffer[64] = {0};
+
+        // nothing arrives: the read gives up at the deadline
+        auto start = std::chrono::steady_clock::now();
+        int result = server.read_byte(s, buffer, 4, true, true, 50);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        TEST_ASSERT_EQ(0, result);
+        TEST_ASSERT(elapsed >= std::chrono::milliseconds(50));
+
+        // the reader is woken as soon as the whole message is there
+        std::thread writer(
+            [&]()
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                client.writeS("wa", 2);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                client.writeS("ke", 2);
+            });
+        result = server.read_byte(s, buffer, 4, true, true, 2000);
+        writer.join();
+        TEST_ASSERT_EQ(4, result);
+        TEST_ASSERT_EQ(0, memcmp(buffer, "wake", 4));
+
+        // a reader waiting for more bytes does not delay a smaller read
+        std::thread big_reader(
+            [&]()
+            {
+                uint8_t big[100];
+                server.read_byte(s, big, sizeof(big), true, false, 300);
+            });
+        std::thread small_writer(
+            [&]()
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                client.writeS("tiny", 4);
+            });
+        start = std::chrono::steady_clock::now();
+        result = server.read_byte(s, buffer, 4, true, true, 2000);
+        elapsed = std::chrono::steady_clock::now() - start;
+        small_writer.join();
+        big_reader.join();
+        TEST_ASSERT_EQ(4, result);
+        TEST_ASSERT_EQ(0, memcmp(buffer, "tiny", 4));
+        TEST_ASSERT(elapsed < std::chrono::milliseconds(200));
+
+        // a disconnection releases a reader waiting without deadline
+        std::thread closer(
+            [&]()
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                client.close_connection();
+            });
+        result = server.read_byte(s, buffer, 4, true, true);
+        closer.join();
+        TEST_ASSERT(result <= 0);
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_crc_frames()
+{
+    TCPServer server(TEST_PORT + 10, 10, -1);
+    server.set_engine(Server::REACTOR);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 10, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+
+        // frames larger than the FIFO chunks, the second one corrupted
+        const size_t size = 4096; // CRC included
+        std::vector<uint8_t> frame(size), received(size);
+        for(size_t i = 0; i < size; i++) frame[i] = i * 3;
+        client.writeS(frame.data(), size - 2, true);
+        frame[10] ^= 1;
+        client.writeS(frame.data(), size);
+        frame[10] ^= 1;
+
+        TEST_ASSERT_EQ((int)size, server.read_frame(s, received.data(), size,
+                                                    true, 2000));
+        TEST_ASSERT_EQ(0, memcmp(received.data(), frame.data(), size));
+        TEST_ASSERT_EQ(-1, server.read_frame(s, received.data(), size, true,
+                                             2000));
+        TEST_ASSERT_EQ(0, server.read_frame(s, received.data(), size));
+
+        // the client checks the CRC while the chunks arrive
+        std::vector<uint8_t> echo(frame.begin(), frame.end());
+        server.send_data(echo.data(), size, s);
+        TEST_ASSERT_EQ((int)size,
+                       client.readS(received.data(), size, true));
+        echo[size - 1] ^= 1;
+        server.send_data(echo.data(), size, s);
+        TEST_ASSERT_EQ(-1, client.readS(received.data(), size, true));
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_vectored_write()
+{
+    TCPServer server(TEST_PORT + 11, 10, -1);
+    server.set_engine(Server::REACTOR);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 11, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+
+        // header + const payload, the CRC goes in its own segment
+        uint8_t header[4] = {0xAA, 0x55, 0, 10};
+        const char payload[] = "0123456789";
+        struct iovec segments[2] = {{header, 4}, {(void *)payload, 10}};
+        TEST_ASSERT_EQ(16, client.writevS(segments, 2, true));
+        TEST_ASSERT_EQ(14, client.writevS(segments, 2));
+        TEST_ASSERT_EQ(0, memcmp(payload, "0123456789", 10));
+
+        uint8_t frame[16];
+        TEST_ASSERT_EQ(16, server.read_frame(s, frame, 16, true, 2000));
+        TEST_ASSERT_EQ(0, memcmp(frame, header, 4));
+        TEST_ASSERT_EQ(0, memcmp(frame + 4, payload, 10));
+        TEST_ASSERT_EQ(14, server.read_byte(s, frame, 14, true, true, 2000));
+        TEST_ASSERT_EQ(0, memcmp(frame + 4, payload, 10));
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_buffered_read()
+{
+    TCPServer server(TEST_PORT + 12, 10, -1);
+    server.set_engine(Server::REACTOR);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 12, 2);
+        client.set_buffered(true, 4096);
+        TEST_ASSERT(client.is_buffered());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+
+        // 200 small messages sent at once, read back one by one
+        std::vector<uint8_t> data(200 * 8);
+        for(size_t i = 0; i < data.size(); i++) data[i] = i;
+        server.send_data(data.data(), data.size(), s);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(data.size(), client.readable());
+
+        uint8_t buffer[8];
+        TEST_ASSERT_EQ(4, client.peekS(buffer, 4));
+        TEST_ASSERT_EQ(0, memcmp(buffer, data.data(), 4));
+        uint64_t before = client.rx_syscalls();
+        for(size_t i = 0; i < 200; i++)
+        {
+            TEST_ASSERT_EQ(8, client.readS(buffer, 8, false, true));
+            TEST_ASSERT_EQ(0, memcmp(buffer, &data[i * 8], 8));
+        }
+        TEST_ASSERT(client.rx_syscalls() - before < 20);
+        TEST_ASSERT_EQ(0u, client.readable());
+
+        // CRC frames, the second one split across two fills of the ring
+        const size_t size = 3000; // CRC included
+        std::vector<uint8_t> frame(size), received(size);
+        for(size_t i = 0; i < size; i++) frame[i] = i * 7;
+        CRC16_XMODEM::spec().append(frame.data(), size - 2);
+        server.send_data(frame.data(), size, s);
+        server.send_data(frame.data(), size, s);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        for(int i = 0; i < 2; i++)
+        {
+            TEST_ASSERT_EQ((int)size,
+                           client.readS(received.data(), size, true));
+            TEST_ASSERT_EQ(0, memcmp(received.data(), frame.data(), size));
+        }
+        frame[5] ^= 1;
+        server.send_data(frame.data(), size, s);
+        TEST_ASSERT_EQ(-1, client.readS(received.data(), size, true));
+
+        // reads larger than the ring bypass it
+        std::vector<uint8_t> big(10000, 0x5A), big_received(10000);
+        server.send_data(big.data(), big.size(), s);
+        TEST_ASSERT_EQ((int)big.size(),
+                       client.readS(big_received.data(), big.size(), false,
+                                    true));
+        TEST_ASSERT(big == big_received);
+
+        // bytes left unread in the ring are not read from the next
+        // connection
+        server.send_data(data.data(), 16, s);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        TEST_ASSERT_EQ(8, client.readS(buffer, 8, false, true));
+        TEST_ASSERT_EQ(8u, client.readable());
+        client.close_connection();
+        client.open_connection("127.0.0.1", TEST_PORT + 12, 2);
+        TEST_ASSERT(client.is_buffered());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s2 = *server.get_clients().begin();
+        TEST_ASSERT_EQ(0u, client.readable());
+        server.send_data(&data[800], 8, s2);
+        TEST_ASSERT_EQ(4, client.peekS(buffer, 4, true));
+        TEST_ASSERT_EQ(0, memcmp(buffer, &data[800], 4));
+        TEST_ASSERT_EQ(8, client.readS(buffer, 8, false, true));
+        TEST_ASSERT_EQ(0, memcmp(buffer, &data[800], 8));
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    client.close_connection();
+    server.stop();
+    return true;
+}
+
+bool test_tcp_framer()
+{
+    // frames seen by the server callback
+    static std::vector<std::string> frames;
+    frames.clear();
+    TCPServer server(TEST_PORT + 13, 10, -1);
+    server.set_engine(Server::REACTOR);
+    server.set_frame_callback(
+        Framer::length_prefix(2, true, true),
+        [](Server *, const uint8_t *frame, size_t size, SOCKET, void *)
+        { frames.push_back(std::string((const char *)frame, size)); });
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 13, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+
+        // frames split across writes, and one with a bad CRC
+        uint8_t frame[16] = {0, 5, 'h', 'e', 'l', 'l', 'o'};
+        client.writeS(frame, 3);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CRC16_XMODEM::spec().append(frame, 7);
+        client.writeS(frame + 3, 6);
+        frame[2] = 'j';
+        client.writeS(frame, 9);
+        frame[1] = 3;
+        client.writeS(frame, 5, true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        TEST_ASSERT_EQ(2u, frames.size());
+        TEST_ASSERT(frames[0] == "hello");
+        TEST_ASSERT(frames[1] == "jel");
+        TEST_ASSERT_EQ(0, server.is_available(s));
+
+        // the client reads delimited frames in place from its buffer
+        const char lines[] = "one\ntwo\nthree\n";
+        server.send_data(lines, strlen(lines), s);
+        Framer framer = Framer::delimiter("\n");
+        const char *expected[] = {"one", "two", "three"};
+        for(const char *line : expected)
+        {
+            const uint8_t *payload;
+            size_t size;
+            TEST_ASSERT_EQ(1, client.read_frame(framer, payload, size));
+            TEST_ASSERT(std::string((const char *)payload, size) == line);
+        }
+        TEST_ASSERT(client.is_buffered());
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_coalescing()
+{
+    TCPServer server(TEST_PORT + 14, 10, -1);
+    server.set_engine(Server::REACTOR);
+    server.set_coalescing(1000);
+    server.set_send_queue(32 * 1024 * 1024);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 14, 2);
+        client.set_coalescing(true, 1000, 4096);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+
+        // 100 small messages leave in a few sends, within the budget
+        uint8_t msg[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+        for(int i = 0; i < 100; i++)
+            TEST_ASSERT_EQ(8, client.writeS(msg, 8));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        TEST_ASSERT_EQ(800, server.is_available(s));
+        TEST_ASSERT(client.tx_syscalls() < 10);
+
+        // past the threshold the queue leaves at once
+        std::vector<uint8_t> big(5000, 0x11);
+        TEST_ASSERT_EQ(8, client.writeS(msg, 8));
+        TEST_ASSERT_EQ(5000, client.writeS(big.data(), big.size()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        TEST_ASSERT_EQ(5808, server.is_available(s));
+        server.clear_fifo(s);
+
+        // an explicit flush does not wait for the budget
+        client.set_coalescing(true, 10000000);
+        client.writeS(msg, 8);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        TEST_ASSERT_EQ(0, server.is_available(s));
+        TEST_ASSERT_EQ(8, client.flush());
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        TEST_ASSERT_EQ(8, server.is_available(s));
+
+        // the server side coalesces too
+        for(int i = 0; i < 50; i++) server.send_data(msg, 8, s);
+        std::vector<uint8_t> received(400);
+        TEST_ASSERT_EQ(400, client.readS(received.data(), 400));
+        TEST_ASSERT_EQ(0, memcmp(received.data() + 392, msg, 8));
+
+        // a client that does not read: the socket fills up and the
+        // coalesced bytes go to the send queue, none is lost
+        const size_t msg_size = 1000, n_msgs = 8000;
+        std::vector<uint8_t> chunk(msg_size);
+        for(size_t i = 0; i < n_msgs; i++)
+        {
+            for(size_t j = 0; j < msg_size; j++)
+                chunk[j] = (uint8_t)((i * msg_size + j) % 251);
+            TEST_ASSERT_EQ(0, server.send_data(chunk.data(), msg_size, s));
+        }
+        TEST_ASSERT(server.send_backlog(s) > 0);
+        bool in_order = true;
+        for(size_t got = 0; got < n_msgs * msg_size; got += msg_size)
+        {
+            if(client.readS(chunk.data(), msg_size) != (int)msg_size)
+            {
+                in_order = false;
+                break;
+            }
+            for(size_t j = 0; j < msg_size; j++)
+                in_order &= chunk[j] == (uint8_t)((got + j) % 251);
+        }
+        TEST_ASSERT(in_order);
+        TEST_ASSERT_EQ(0u, server.send_dropped(s));
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_connect_all()
+{
+    TCPServer server(TEST_PORT + 15, 64, -1);
+    server.set_engine(Server::REACTOR);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    try
+    {
+        // "localhost" may give ::1 first, refused by the IPv4 server
+        std::vector<TCP::Endpoint> endpoints = {
+            {"127.0.0.1", TEST_PORT + 15},
+            {"127.0.0.1", TEST_PORT + 98}, // nobody listens
+            {"localhost", TEST_PORT + 15}};
+        for(int i = 0; i < 20; i++)
+            endpoints.push_back({"127.0.0.1", TEST_PORT + 15});
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<TCP::ConnectResult> results =
+            TCP::connect_all(endpoints, 2000);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        TEST_ASSERT(elapsed < std::chrono::milliseconds(1000));
+        TEST_ASSERT_EQ(endpoints.size(), results.size());
+        TEST_ASSERT(results[0].client != nullptr);
+        TEST_ASSERT(results[1].client == nullptr);
+        TEST_ASSERT(!results[1].error.empty());
+        TEST_ASSERT(results[2].client != nullptr);
+        for(size_t i = 3; i < results.size(); i++)
+            TEST_ASSERT(results[i].client && results[i].client->is_connected());
+
+        // the connected clients are usable
+        TEST_ASSERT_EQ(4, results[0].client->writeS("ping", 4));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(22u, server.get_clients().size());
+        for(auto &result : results)
+            if(result.client)
+                result.client->close_connection();
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_socket_profile()
+{
+    TCPServer server(TEST_PORT + 16, 10, -1);
+    server.set_engine(Server::REACTOR);
+    server.set_profile(SocketProfile::low_latency());
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client(-1);
+    try
+    {
+        // set before the connection, applied to the new socket
+        SocketProfile bulk = SocketProfile::bulk_throughput();
+        bulk.rcvbuf = bulk.sndbuf = 256 * 1024;
+        TEST_ASSERT_EQ(-1, client.set_profile(bulk).rcvbuf);
+        client.open_connection("127.0.0.1", TEST_PORT + 16, 2);
+        SocketProfile applied = client.get_profile();
+        TEST_ASSERT_EQ(0, applied.nodelay);
+        TEST_ASSERT_EQ(0x08, applied.tos);
+        TEST_ASSERT(applied.rcvbuf >= 256 * 1024);
+
+        // the accepted socket gets the server profile
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+        applied = server.get_profile(s);
+        TEST_ASSERT_EQ(1, applied.nodelay);
+        TEST_ASSERT_EQ(0x10, applied.tos);
+        TEST_ASSERT_EQ(16 * 1024, applied.notsent_lowat);
+        TEST_ASSERT(!applied.to_string().empty());
+
+        // and on an open socket
+        applied = client.set_profile(SocketProfile::low_latency());
+        TEST_ASSERT_EQ(1, applied.nodelay);
+
+        client.writeS("tuned", 5);
+        uint8_t buffer[8];
+        TEST_ASSERT_EQ(5, server.read_byte(s, buffer, 5, true, true, 2000));
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_zerocopy()
+{
+    TCPServer server(TEST_PORT + 17, 10, -1);
+    server.set_engine(Server::REACTOR);
+    server.set_zerocopy(16 * 1024);
+    server.set_send_queue(32 * 1024 * 1024);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 17, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+
+        // a large buffer is reusable once its completion is read (the
+        // loopback copies it, but still reports the completion)
+        std::vector<uint8_t> big(32 * 1024);
+        for(size_t i = 0; i < big.size(); i++) big[i] = (uint8_t)i;
+        uint64_t id = 0;
+        TEST_ASSERT_EQ((int)big.size(),
+                       client.write_zerocopy(big.data(), big.size(), &id));
+        TEST_ASSERT(client.zerocopy_done(id, 2000));
+        std::vector<uint8_t> received(big.size());
+        TEST_ASSERT_EQ((int)big.size(),
+                       server.read_byte(s, received.data(), received.size(),
+                                        true, true, 2000));
+        TEST_ASSERT(received == big);
+
+        // small buffers are copied and done at once
+        TEST_ASSERT_EQ(5, client.write_zerocopy("small", 5, &id));
+        TEST_ASSERT_EQ(0u, id);
+        TEST_ASSERT(client.zerocopy_done(id));
+
+        // server to client, the reactor keeps the connection on the
+        // completion notifications
+        for(int i = 0; i < 4; i++)
+        {
+            TEST_ASSERT_EQ((int)big.size(),
+                           server.send_zerocopy(big.data(), big.size(), s, &id));
+            TEST_ASSERT_EQ((int)big.size(),
+                           client.readS(received.data(), received.size()));
+            TEST_ASSERT(received == big);
+        }
+        TEST_ASSERT(server.zerocopy_done(s, id, 2000));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+
+        // a client that does not read: the sends do not wait for it, what
+        // the socket does not take is queued
+        std::vector<uint8_t> chunk(1024 * 1024);
+        for(size_t i = 0; i < chunk.size(); i++) chunk[i] = (uint8_t)i;
+        const int n_chunks = 16;
+        uint64_t last_id = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < n_chunks; i++)
+        {
+            TEST_ASSERT_EQ((int)chunk.size(),
+                           server.send_zerocopy(chunk.data(), chunk.size(), s,
+                                                &id));
+            last_id = std::max(last_id, id);
+        }
+        TEST_ASSERT(std::chrono::steady_clock::now() - start <
+                    std::chrono::milliseconds(500));
+        TEST_ASSERT(server.send_backlog(s) > 0);
+        bool in_order = true;
+        for(int i = 0; i < n_chunks; i++)
+        {
+            std::fill(received.begin(), received.end(), 0);
+            for(size_t got = 0; got < chunk.size(); got += received.size())
+            {
+                if(client.readS(received.data(), received.size()) !=
+                   (int)received.size())
+                {
+                    in_order = false;
+                    break;
+                }
+                in_order &= memcmp(received.data(), chunk.data() + got,
+                                   received.size()) == 0;
+            }
+        }
+        TEST_ASSERT(in_order);
+        TEST_ASSERT(server.zerocopy_done(s, last_id, 2000));
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_full_duplex()
+{
+    TCPServer server(TEST_PORT + 18, 10, -1);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 18, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+
+        // a reader blocked on the connection does not hold back the writer:
+        // the reply it waits for is only sent once the command went through
+        uint8_t reply[5] = {};
+        std::thread reader([&]() { client.readS(reply, 5); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        TEST_ASSERT_EQ(3, client.writeS("cmd", 3));
+        uint8_t command[3];
+        TEST_ASSERT_EQ(3, server.read_byte(s, command, 3, true, true, 2000));
+        server.send_data("reply", 5, s);
+        reader.join();
+        TEST_ASSERT_EQ(0, memcmp(reply, "reply", 5));
+
+        // closing while a writer thread coalesces: its next write fails
+        client.set_coalescing(true, 1000);
+        std::atomic<bool> writing(true);
+        std::thread writer(
+            [&]()
+            {
+                uint8_t msg[100] = {};
+                for(int i = 0; i < 1000000 && writing; i++)
+                    if(client.writeS(msg, sizeof(msg)) < 0)
+                        break;
+            });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        client.close_connection();
+        writing = false;
+        writer.join();
+        TEST_ASSERT_EQ(-1, client.writeS("late", 4));
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_timestamping()
+{
+    std::atomic<int> stamped(0);
+    TCPServer server(TEST_PORT + 19, 10, -1);
+    server.set_engine(Server::REACTOR);
+    server.set_timestamping();
+    server.set_timestamped_callback(
+        [](Server *, uint8_t *, size_t, void *, const RxTimestamp &ts,
+           void *user)
+        {
+            if(ts.kernel_ns > 0 && ts.kernel_ns <= ts.user_ns)
+                (*static_cast<std::atomic<int> *>(user))++;
+        },
+        &stamped);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    TCP client(-1);
+    try
+    {
+        client.set_tx_timestamping(true);
+        client.open_connection("127.0.0.1", TEST_PORT + 19, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+
+        int64_t before = Timestamping::now_ns();
+        TEST_ASSERT_EQ(4, client.writeS("ping", 4));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        TEST_ASSERT_EQ(1, stamped.load());
+        TEST_ASSERT_EQ(1u, server.rx_latency().count);
+
+        // the FIFO keeps the timestamp of its oldest byte
+        RxTimestamp ts = server.fifo_timestamp(s);
+        TEST_ASSERT(ts.kernel_ns >= before);
+        TEST_ASSERT_EQ(4, server.is_available(s));
+        uint8_t buffer[4];
+        server.read_byte(s, buffer, 4);
+        TEST_ASSERT_EQ(0, server.fifo_timestamp(s).kernel_ns);
+
+        // the loopback peer ACKs at once
+        TEST_ASSERT_EQ(1u, client.send_latency().count);
+        TEST_ASSERT_EQ(1u, client.ack_latency().count);
+        TEST_ASSERT(client.ack_latency().min_ns >= 0);
+
+        // zero-copy writes share the error queue with the timestamps: each
+        // reader gets its own reports, whichever reads first
+        client.set_zerocopy_threshold(16 * 1024);
+        std::vector<uint8_t> big(32 * 1024, 0x5a);
+        uint64_t id = 0;
+        for(int i = 0; i < 3; i++)
+            TEST_ASSERT_EQ((int)big.size(),
+                           client.write_zerocopy(big.data(), big.size(), &id));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        TEST_ASSERT_EQ(4u, client.send_latency().count);
+        TEST_ASSERT(client.zerocopy_done(id, 1000));
+        TEST_ASSERT_EQ(4u, client.ack_latency().count);
+        client.close_connection();
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_shards()
+{
+    TCPServer server(TEST_PORT + 20, 64, -1);
+    server.set_shards(4);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    const int n_clients = 32;
+    std::vector<std::unique_ptr<TCP>> clients;
+    try
+    {
+        for(int i = 0; i < n_clients; i++)
+        {
+            clients.emplace_back(new TCP(-1));
+            clients.back()->open_connection("127.0.0.1", TEST_PORT + 20, 2);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        // the kernel spread the connections, the registry sees them all
+        TEST_ASSERT_EQ((size_t)n_clients, server.get_clients().size());
+        std::vector<uint64_t> accepts = server.shard_accepts();
+        TEST_ASSERT_EQ(4u, accepts.size());
+        uint64_t total = 0;
+        int used = 0;
+        for(uint64_t n : accepts)
+        {
+            total += n;
+            used += n > 0;
+        }
+        TEST_ASSERT_EQ((uint64_t)n_clients, total);
+        TEST_ASSERT(used > 1);
+
+        // every client is served whatever its shard
+        for(SOCKET s : server.get_clients()) server.send_data("shard", 5, s);
+        for(auto &client : clients)
+        {
+            uint8_t buffer[5];
+            TEST_ASSERT_EQ(5, client->readS(buffer, 5));
+            client->writeS("ok", 2);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(2u * n_clients, server.rx_bytes());
+        for(auto &client : clients) client->close_connection();
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_client_registry()
+{
+    TCPServer server(TEST_PORT + 21, 64, -1);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // a monitor takes snapshots while the clients come and go (the socket
+    // numbers are reused from one round to the next)
+    std::atomic<bool> running(true);
+    std::atomic<uint64_t> snapshots(0);
+    std::thread monitor(
+        [&]()
+        {
+            while(running)
+            {
+                for(SOCKET s : server.get_clients()) server.is_available(s);
+                snapshots++;
+            }
+        });
+
+    bool ok = true;
+    try
+    {
+        for(int round = 0; round < 5 && ok; round++)
+        {
+            std::vector<std::unique_ptr<TCP>> clients;
+            for(int i = 0; i < 8; i++)
+            {
+                clients.emplace_back(new TCP(-1));
+                clients.back()->open_connection("127.0.0.1", TEST_PORT + 21, 2);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            Snapshot<SOCKET> before = server.get_clients();
+            ok = ok && before.size() == 8;
+            for(auto &client : clients) client->close_connection();
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            // a snapshot does not change once taken
+            ok = ok && before.size() == 8 && server.get_clients().empty();
+        }
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << "  Error: " << e.what() << std::endl;
+        ok = false;
+    }
+    running = false;
+    monitor.join();
+    server.stop();
+    TEST_ASSERT(ok);
+    TEST_ASSERT(snapshots > 0);
+    return true;
+}
+
+bool test_tcp_connection_handles()
+{
+    TCPServer server(TEST_PORT + 22, 10, -1);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    try
+    {
+        TCP first(-1);
+        first.open_connection("127.0.0.1", TEST_PORT + 22, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(1u, server.get_clients().size());
+        SOCKET s = *server.get_clients().begin();
+        TCPServer::Handle h = server.get_handle(s);
+        TEST_ASSERT(h.valid());
+        TEST_ASSERT_EQ(s, h.socket());
+        TEST_ASSERT(h == server.get_handle(s));
+
+        first.writeS("ping", 4);
+        uint8_t buffer[4];
+        TEST_ASSERT_EQ(4, server.read_byte(h, buffer, 4, true, true, 1000));
+        TEST_ASSERT(memcmp(buffer, "ping", 4) == 0);
+        TEST_ASSERT_EQ(0, server.send_data("pong", 4, h));
+        TEST_ASSERT_EQ(4, first.readS(buffer, 4));
+
+        first.close_connection();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT(!h.valid());
+        TEST_ASSERT_EQ(-1, server.is_available(h));
+
+        // the next client may get the same socket number, the old handle
+        // must not reach it
+        TCP second(-1);
+        second.open_connection("127.0.0.1", TEST_PORT + 22, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TCPServer::Handle h2 = server.get_handle(*server.get_clients().begin());
+        TEST_ASSERT(h2.valid());
+        TEST_ASSERT(h2 != h);
+        TEST_ASSERT(h2.generation() > h.generation());
+        TEST_ASSERT_EQ(-1, server.send_data("stale", 5, h));
+        TEST_ASSERT_EQ(-1, server.read_byte(h, buffer, 4));
+        TEST_ASSERT(!server.get_handle(-1).valid());
+        second.close_connection();
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_broadcast_queue()
+{
+    TCPServer server(TEST_PORT + 23, 10, -1);
+    server.set_send_queue(256 * 1024, SendQueue::DROP);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    const size_t msg_size = 64 * 1024;
+    const int n_msgs = 128;
+    TCP slow(-1);
+    TCP fast(-1);
+    try
+    {
+        // the slow client never reads
+        SocketProfile tiny;
+        tiny.rcvbuf = 32 * 1024;
+        slow.set_profile(tiny);
+        slow.open_connection("127.0.0.1", TEST_PORT + 23, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        SOCKET slow_s = *server.get_clients().begin();
+        fast.open_connection("127.0.0.1", TEST_PORT + 23, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TEST_ASSERT_EQ(2u, server.get_clients().size());
+        SOCKET fast_s = INVALID_SOCKET;
+        for(SOCKET s : server.get_clients())
+            if(s != slow_s)
+                fast_s = s;
+
+        std::atomic<size_t> received(0);
+        std::thread reader(
+            [&]()
+            {
+                std::vector<uint8_t> buffer(msg_size);
+                while(received < msg_size * n_msgs)
+                {
+                    int n = fast.readS(buffer.data(), buffer.size(), false,
+                                       false);
+                    if(n <= 0)
+                        break;
+                    received += n;
+                }
+            });
+
+        std::vector<uint8_t> msg(msg_size, 0x5a);
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < n_msgs; i++)
+        {
+            // paced on the fast client only
+            while(server.send_backlog(fast_s) > 128 * 1024)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            SharedBuffer shared = make_shared_buffer(msg.data(), msg.size());
+            TEST_ASSERT(server.broadcast(shared) >= 1);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        reader.join();
+
+        // the slow client did not hold the producer
+        TEST_ASSERT(elapsed < std::chrono::seconds(2));
+        TEST_ASSERT_EQ(msg_size * n_msgs, received.load());
+        TEST_ASSERT_EQ(0u, server.send_dropped(fast_s));
+        TEST_ASSERT(server.send_dropped(slow_s) > 0);
+        TEST_ASSERT(server.send_backlog(slow_s) <= 256 * 1024);
+        TEST_ASSERT(server.send_backlog(slow_s) > 0);
+
+        fast.close_connection();
+        slow.close_connection();
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_send_queue()
+{
+    TCPServer server(TEST_PORT + 24, 10, -1);
+    server.set_engine(Server::REACTOR);
+    server.set_send_queue(1024 * 1024, SendQueue::DROP);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    struct Counts
+    {
+        std::atomic<int> sent{0};
+        std::atomic<int> dropped{0};
+    } counts;
+    SendQueue::Callback on_done = [](void *data, bool sent)
+    {
+        Counts *counts = static_cast<Counts *>(data);
+        (sent ? counts->sent : counts->dropped)++;
+    };
+
+    const size_t msg_size = 64 * 1024;
+    const int n_msgs = 256;
+    TCP client(-1);
+    try
+    {
+        SocketProfile small;
+        small.rcvbuf = 64 * 1024;
+        client.set_profile(small);
+        client.open_connection("127.0.0.1", TEST_PORT + 24, 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TCPServer::Handle h = server.get_handle(*server.get_clients().begin());
+
+        // the client does not read yet: the socket buffers fill up (a few
+        // MB on the loopback), then the queue, none of the sends blocks
+        std::vector<uint8_t> msg(msg_size, 0x33);
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < n_msgs; i++)
+            server.send_data(msg.data(), msg.size(), h, on_done, &counts);
+        TEST_ASSERT(std::chrono::steady_clock::now() - start <
+                    std::chrono::milliseconds(500));
+        TEST_ASSERT(server.send_backlog(h) > 0);
+        TEST_ASSERT(server.send_backlog(h) <= 1024 * 1024);
+        TEST_ASSERT(!server.flush(h, std::chrono::steady_clock::now() +
+                                         std::chrono::milliseconds(50)));
+        int dropped = counts.dropped;
+        TEST_ASSERT(dropped > 0);
+        TEST_ASSERT_EQ((uint64_t)dropped, server.send_dropped(h));
+
+        // whole messages only: the reader gets the kept ones in full
+        size_t expected = (n_msgs - dropped) * msg_size;
+        std::thread reader(
+            [&]()
+            {
+                std::vector<uint8_t> buffer(msg_size);
+                for(size_t got = 0; got < expected; got += msg_size)
+                    if(client.readS(buffer.data(), msg_size) <= 0)
+                        break;
+            });
+        bool flushed = server.flush(h, std::chrono::steady_clock::now() +
+                                           std::chrono::seconds(5));
+        reader.join();
+        TEST_ASSERT(flushed);
+        TEST_ASSERT_EQ(0u, server.send_backlog(h));
+        TEST_ASSERT_EQ(n_msgs - dropped, counts.sent.load());
+        client.close_connection();
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_tcp_fifo_backpressure()
+{
+    Server::Engine engines[] = {Server::THREADS, Server::REACTOR,
+                                Server::IO_URING};
+    for(int e = 0; e < 3; e++)
+    {
+        TCPServer server(TEST_PORT + 25 + e, 10, -1);
+        server.set_engine(engines[e]);
+        FifoLimits limits;
+        limits.capacity = 64 * 1024;
+        limits.policy = FifoLimits::PAUSE;
+        server.set_fifo_limits(limits);
+        server.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        size_t budget_before = MemoryBudget::instance().used();
+
+        // bytes received past the pause: one receive chunk, or with
+        // io_uring the provided buffers filled before the cancellation
+        size_t slack = e == 2 ? 256 * 16384 : 16 * 1024;
+        const size_t total = 8 * 1024 * 1024;
+        TCP client(-1);
+        try
+        {
+            client.open_connection("127.0.0.1", TEST_PORT + 25 + e, 2);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            TCPServer::Handle h =
+                server.get_handle(*server.get_clients().begin());
+
+            // the server stops reading: the sender is held by TCP, not by
+            // an ever growing FIFO
+            std::thread writer(
+                [&]()
+                {
+                    std::vector<uint8_t> data(total);
+                    for(size_t i = 0; i < total; i++) data[i] = (uint8_t)i;
+                    client.writeS(data.data(), data.size());
+                });
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            FifoStats stats = server.fifo_stats(h);
+            TEST_ASSERT(stats.pauses >= 1);
+            TEST_ASSERT(stats.size <= limits.capacity + slack);
+            TEST_ASSERT(stats.size >= limits.capacity);
+            TEST_ASSERT(MemoryBudget::instance().used() >=
+                        budget_before + stats.size);
+
+            // reading resumes the socket, no byte is lost
+            std::vector<uint8_t> buffer(4096);
+            bool in_order = true;
+            for(size_t got = 0; got < total;)
+            {
+                int n = server.read_byte(h, buffer.data(), buffer.size(),
+                                         true, true, 2000);
+                if(n <= 0)
+                    break;
+                for(int i = 0; i < n; i++)
+                    in_order &= buffer[i] == (uint8_t)(got + i);
+                got += n;
+            }
+            writer.join();
+            stats = server.fifo_stats(h);
+            TEST_ASSERT(in_order);
+            TEST_ASSERT_EQ((uint64_t)total, server.rx_bytes());
+            TEST_ASSERT_EQ(0u, stats.dropped);
+            TEST_ASSERT_EQ(0u, stats.size);
+            TEST_ASSERT(stats.high_water <= limits.capacity + slack);
+            client.close_connection();
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            TEST_ASSERT_EQ(budget_before, MemoryBudget::instance().used());
+        }
+        catch(const std::exception &ex)
+        {
+            server.stop();
+            std::cerr << "  Error: " << ex.what() << std::endl;
+            return false;
+        }
+        server.stop();
+    }
+
+    // a framer only consumes whole frames: limits that cannot hold one
+    // would stall the connection
+    TCPServer server(TEST_PORT + 28, 10, -1);
+    FifoLimits small;
+    small.capacity = 1024;
+    server.set_fifo_limits(small);
+    bool rejected = false;
+    try
+    {
+        server.set_frame_callback(Framer::delimiter("\n", false, 4096),
+                                  nullptr);
+    }
+    catch(const std::exception &)
+    {
+        rejected = true;
+    }
+    TEST_ASSERT(rejected);
+    server.set_frame_callback(Framer::delimiter("\n", false, 512), nullptr);
+    rejected = false;
+    try
+    {
+        small.capacity = 768; // resumes under 384 bytes
+        server.set_fifo_limits(small);
+    }
+    catch(const std::exception &)
+    {
+        rejected = true;
+    }
+    TEST_ASSERT(rejected);
+    // dropping the oldest bytes would cut the frame being parsed
+    rejected = false;
+    try
+    {
+        small.capacity = 4096;
+        small.policy = FifoLimits::DROP_OLDEST;
+        server.set_fifo_limits(small);
+    }
+    catch(const std::exception &)
+    {
+        rejected = true;
+    }
+    TEST_ASSERT(rejected);
+    TCPServer framed(TEST_PORT + 28, 10, -1);
+    framed.set_fifo_limits(small);
+    rejected = false;
+    try
+    {
+        framed.set_frame_callback(Framer::delimiter("\n", false, 512), nullptr);
+    }
+    catch(const std::exception &)
+    {
+        rejected = true;
+    }
+    TEST_ASSERT(rejected);
+    return true;
+}
+
 int main()
 {
     Test::TestRunner runner;
@@ -332,6 +1606,25 @@ int main()
     runner.add_test("TCP connection timeout", test_tcp_connection_timeout);
     runner.add_test("TCP server broadcast", test_tcp_server_broadcast);
     runner.add_test("TCP new client callback", test_tcp_new_client_callback);
+    runner.add_test("TCP reactor engine", test_tcp_reactor_engine);
+    runner.add_test("TCP io_uring engine", test_tcp_uring_engine);
+    runner.add_test("TCP blocking read wakeup", test_tcp_blocking_read_wakeup);
+    runner.add_test("TCP CRC frames", test_tcp_crc_frames);
+    runner.add_test("TCP vectored write", test_tcp_vectored_write);
+    runner.add_test("TCP buffered read", test_tcp_buffered_read);
+    runner.add_test("TCP framer", test_tcp_framer);
+    runner.add_test("TCP write coalescing", test_tcp_coalescing);
+    runner.add_test("TCP parallel connect", test_tcp_connect_all);
+    runner.add_test("TCP socket profile", test_tcp_socket_profile);
+    runner.add_test("TCP zero-copy send", test_tcp_zerocopy);
+    runner.add_test("TCP full duplex", test_tcp_full_duplex);
+    runner.add_test("TCP timestamping", test_tcp_timestamping);
+    runner.add_test("TCP SO_REUSEPORT shards", test_tcp_shards);
+    runner.add_test("TCP client registry", test_tcp_client_registry);
+    runner.add_test("TCP connection handles", test_tcp_connection_handles);
+    runner.add_test("TCP broadcast queues", test_tcp_broadcast_queue);
+    runner.add_test("TCP send queue", test_tcp_send_queue);
+    runner.add_test("TCP FIFO backpressure", test_tcp_fifo_backpressure);
 
     return runner.run();
 }
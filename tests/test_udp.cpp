@@ -315,6 +315,219 @@ bool test_udp_large_datagram()
     return true;
 }
 
+// Test: IO_URING engine (or its thread fallback) receives datagrams
+bool test_udp_uring_engine()
+{
+    std::atomic<int> message_count(0);
+
+    UDPServer server(TEST_PORT + 7);
+    server.set_engine(Server::IO_URING);
+    server.set_callback(
+        [](Server *, uint8_t *data, size_t len, void *, void *user) {
+            auto *count = static_cast<std::atomic<int> *>(user);
+            if(len == 5 && memcmp(data, "uring", 5) == 0)
+                (*count)++;
+        },
+        &message_count);
+
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    UDP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 7, 0);
+        for(int i = 0; i < 10; i++) client.writeS("uring", 5);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        TEST_ASSERT_EQ(10, message_count.load());
+        TEST_ASSERT_EQ(50u, server.rx_bytes());
+
+        client.close_connection();
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_udp_vectored_write()
+{
+    std::atomic<int> valid_count{0};
+    UDPServer server(TEST_PORT + 8);
+    server.set_callback(
+        [](Server *, uint8_t *data, size_t len, void *, void *user) {
+            auto *count = static_cast<std::atomic<int> *>(user);
+            CRCAccumulator crc;
+            crc.update(data, len - 2);
+            if(len == 9 && memcmp(data, "hdr:body", 7) == 0 &&
+               crc.verify(data + 7))
+                (*count)++;
+        },
+        &valid_count);
+
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    UDP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 8, 0);
+        struct iovec segments[2] = {{(void *)"hdr:", 4}, {(void *)"body", 3}};
+        for(int i = 0; i < 5; i++)
+            TEST_ASSERT_EQ(9, client.writevS(segments, 2, true));
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        TEST_ASSERT_EQ(5, valid_count.load());
+        client.close_connection();
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_udp_socket_profile()
+{
+    UDPServer server(TEST_PORT + 9);
+    SocketProfile profile;
+    profile.rcvbuf = 128 * 1024; // below the default rmem_max
+    profile.nodelay = 1; // TCP only, ignored
+    server.set_profile(profile);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    UDP client(-1);
+    try
+    {
+        client.set_profile(profile);
+        client.open_connection("127.0.0.1", TEST_PORT + 9, 0);
+        SocketProfile applied = client.get_profile();
+        TEST_ASSERT(applied.rcvbuf >= 128 * 1024);
+        TEST_ASSERT_EQ(-1, applied.nodelay);
+        TEST_ASSERT(server.get_profile().rcvbuf >= 128 * 1024);
+        client.close_connection();
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
+bool test_udp_timestamping()
+{
+    // the io_uring engine takes the timestamp from the recvmsg control data
+    Server::Engine engines[] = {Server::THREADS, Server::IO_URING};
+    for(int i = 0; i < 2; i++)
+    {
+        std::atomic<int> stamped(0);
+        UDPServer server(TEST_PORT + 10 + i);
+        server.set_engine(engines[i]);
+        server.set_timestamping();
+        server.set_timestamped_callback(
+            [](Server *, uint8_t *, size_t, void *, const RxTimestamp &ts,
+               void *user)
+            {
+                auto *count = static_cast<std::atomic<int> *>(user);
+                if(ts.kernel_ns > 0 && ts.kernel_ns <= ts.user_ns)
+                    (*count)++;
+            },
+            &stamped);
+        server.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        UDP client(-1);
+        try
+        {
+            client.set_tx_timestamping(true);
+            client.open_connection("127.0.0.1", TEST_PORT + 10 + i, 0);
+            for(int j = 0; j < 5; j++) client.writeS("stamp", 5);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+            TEST_ASSERT_EQ(5, stamped.load());
+            TEST_ASSERT_EQ(5u, server.rx_latency().count);
+            TEST_ASSERT(server.rx_latency().min_ns >= 0);
+            TEST_ASSERT_EQ(5u, client.send_latency().count);
+            TEST_ASSERT_EQ(0u, client.ack_latency().count); // TCP only
+            client.close_connection();
+        }
+        catch(const std::exception &e)
+        {
+            server.stop();
+            std::cerr << "  Error: " << e.what() << std::endl;
+            return false;
+        }
+        server.stop();
+    }
+    return true;
+}
+
+bool test_udp_fifo_limits()
+{
+    UDPServer server(TEST_PORT + 12);
+    FifoLimits limits;
+    limits.capacity = 1000;
+    limits.policy = FifoLimits::DROP_OLDEST;
+    server.set_fifo_limits(limits);
+    server.set_callback([](Server *, uint8_t *, size_t, void *, void *) {});
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    UDP client(-1);
+    try
+    {
+        client.open_connection("127.0.0.1", TEST_PORT + 12, 0);
+        uint8_t datagram[100] = {0};
+        for(int i = 0; i < 20; i++) client.writeS(datagram, sizeof(datagram));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        // the last ten datagrams are kept
+        SOCKADDR_IN addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        FifoStats stats = server.fifo_stats(addr);
+        TEST_ASSERT_EQ(1000u, stats.size);
+        TEST_ASSERT_EQ(1000u, stats.high_water);
+        TEST_ASSERT_EQ(1000u, stats.dropped);
+        TEST_ASSERT_EQ(1000u, server.rx_dropped());
+        TEST_ASSERT_EQ(2000u, server.rx_bytes());
+
+        // whole datagrams are dropped: two of 100 bytes make room for 150
+        uint8_t larger[150] = {0};
+        client.writeS(larger, sizeof(larger));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        stats = server.fifo_stats(addr);
+        TEST_ASSERT_EQ(950u, stats.size);
+        TEST_ASSERT_EQ(1200u, stats.dropped);
+        client.close_connection();
+    }
+    catch(const std::exception &e)
+    {
+        server.stop();
+        std::cerr << "  Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    server.stop();
+    return true;
+}
+
 int main()
 {
     Test::TestRunner runner;
@@ -327,6 +540,11 @@ int main()
     runner.add_test("UDP connectionless", test_udp_connectionless);
     runner.add_test("UDP server reply", test_udp_server_reply);
     runner.add_test("UDP large datagram", test_udp_large_datagram);
+    runner.add_test("UDP io_uring engine", test_udp_uring_engine);
+    runner.add_test("UDP vectored write", test_udp_vectored_write);
+    runner.add_test("UDP socket profile", test_udp_socket_profile);
+    runner.add_test("UDP timestamping", test_udp_timestamping);
+    runner.add_test("UDP FIFO limits", test_udp_fifo_limits);
 
     return runner.run();
 }